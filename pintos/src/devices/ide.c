@@ -123,9 +123,9 @@ ide_init (void)
         default:
           NOT_REACHED ();
         }
-      lock_init (&c->lock);
+      lock_init_named (&c->lock, c->name);
       c->expecting_interrupt = false;
-      sema_init (&c->completion_wait, 0);
+      sema_init_named (&c->completion_wait, 0, "ide completion");
 
       /* Initialize devices. */
       for (dev_no = 0; dev_no < 2; dev_no++)
@@ -0,0 +1,214 @@
+#include "devices/lapic.h"
+#include <debug.h>
+#include "devices/timer.h"
+#include "threads/init.h"
+#include "threads/io.h"
+#include "threads/palloc.h"
+#include "threads/pte.h"
+#include "threads/spinlock.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* Every CPU has its own local APIC, which delivers interrupts
+   to that CPU, sends interprocessor interrupts (IPIs) to other
+   CPUs, and has a timer.  Each CPU sees its own local APIC's
+   registers at the same physical address, which we map,
+   uncached, at LAPIC_VADDR.  See [IA32-v3a] chapter 10
+   "Advanced Programmable Interrupt Controller (APIC)". */
+#define LAPIC_VADDR ((void *) 0xfee00000)
+
+/* Register offsets, in bytes. */
+#define LAPIC_ID	0x020   /* Local APIC ID. */
+#define LAPIC_TPR	0x080   /* Task priority. */
+#define LAPIC_EOI	0x0b0   /* End of interrupt. */
+#define LAPIC_SVR	0x0f0   /* Spurious interrupt vector. */
+#define LAPIC_ESR	0x280   /* Error status. */
+#define LAPIC_ICRLO	0x300   /* Interrupt command, low half. */
+#define LAPIC_ICRHI	0x310   /* Interrupt command, high half. */
+#define LAPIC_TIMER	0x320   /* Local vector table: timer. */
+#define LAPIC_LINT0	0x350   /* Local vector table: LINT0 pin. */
+#define LAPIC_LINT1	0x360   /* Local vector table: LINT1 pin. */
+#define LAPIC_TICR	0x380   /* Timer initial count. */
+#define LAPIC_TCCR	0x390   /* Timer current count. */
+#define LAPIC_TDCR	0x3e0   /* Timer divide configuration. */
+
+/* Register bits. */
+#define SVR_ENABLE	0x00000100      /* APIC software enable. */
+#define ICR_INIT	0x00000500      /* INIT delivery mode. */
+#define ICR_STARTUP	0x00000600      /* Startup (SIPI) delivery mode. */
+#define ICR_PENDING	0x00001000      /* Delivery in progress. */
+#define ICR_ASSERT	0x00004000      /* Level assert. */
+#define ICR_LEVEL	0x00008000      /* Level triggered. */
+#define LVT_MASKED	0x00010000      /* Interrupt masked. */
+#define TIMER_PERIODIC	0x00020000      /* Periodic, not one-shot. */
+#define TDCR_DIV16	0x3             /* Timer clock = bus clock / 16. */
+
+/* CMOS shutdown status byte, and the BIOS warm reset vector
+   that a CPU leaving INIT jumps through when it says so.  See
+   [MP] appendix B.4 "Application Processor Startup". */
+#define CMOS_REG_SET	0x70
+#define CMOS_REG_IO	0x71
+#define CMOS_SHUTDOWN	0x0f
+#define WARM_RESET_VECTOR 0x467
+
+/* Timer counts per timer tick, found by lapic_timer_calibrate(). */
+static uint32_t timer_count;
+
+/* Returns the local APIC register at byte offset REG. */
+static inline volatile uint32_t *
+lapic_reg (int reg)
+{
+  return (volatile uint32_t *) ((uint8_t *) LAPIC_VADDR + reg);
+}
+
+/* Reads local APIC register REG. */
+static inline uint32_t
+lapic_read (int reg)
+{
+  return *lapic_reg (reg);
+}
+
+/* Writes VALUE to local APIC register REG. */
+static inline void
+lapic_write (int reg, uint32_t value)
+{
+  *lapic_reg (reg) = value;
+}
+
+/* Sends interprocessor interrupt command ICR to the CPU whose
+   local APIC ID is APIC_ID and waits for it to be accepted. */
+static void
+send_icr (uint8_t apic_id, uint32_t icr)
+{
+  lapic_write (LAPIC_ICRHI, (uint32_t) apic_id << 24);
+  lapic_write (LAPIC_ICRLO, icr);
+  while (lapic_read (LAPIC_ICRLO) & ICR_PENDING)
+    cpu_relax ();
+}
+
+/* Maps the local APIC, whose registers are at physical address
+   PADDR, into the kernel's page directory and enables the
+   bootstrap processor's local APIC.  Must be called before any
+   process page directory is created, because those copy the
+   kernel's mappings.
+
+   The BIOS left the BSP's local APIC in "virtual wire" mode,
+   passing the PIC's interrupts through LINT0, and we leave that
+   alone so that external interrupts keep going to the BSP. */
+void
+lapic_init (uint32_t paddr)
+{
+  uint32_t *pde = &init_page_dir[pd_no (LAPIC_VADDR)];
+  uint32_t *pt;
+
+  ASSERT ((*pde & PTE_P) == 0);
+  pt = palloc_get_page (PAL_ASSERT | PAL_ZERO);
+  pt[pt_no (LAPIC_VADDR)] = (paddr & PTE_ADDR) | PTE_PCD | PTE_PWT
+                            | PTE_P | PTE_W;
+  *pde = pde_create (pt);
+
+  lapic_write (LAPIC_SVR, lapic_read (LAPIC_SVR) | SVR_ENABLE
+               | LAPIC_VEC_SPURIOUS);
+  lapic_write (LAPIC_TPR, 0);
+}
+
+/* Enables the local APIC of the application processor that
+   calls this function and starts its periodic timer at
+   TIMER_FREQ.  The PIC is wired to the BSP only, so the LINT
+   pins are masked. */
+void
+lapic_init_ap (void)
+{
+  ASSERT (timer_count != 0);
+
+  lapic_write (LAPIC_SVR, SVR_ENABLE | LAPIC_VEC_SPURIOUS);
+  lapic_write (LAPIC_LINT0, LVT_MASKED);
+  lapic_write (LAPIC_LINT1, LVT_MASKED);
+  lapic_write (LAPIC_ESR, 0);
+  lapic_write (LAPIC_ESR, 0);
+  lapic_write (LAPIC_TPR, 0);
+
+  lapic_write (LAPIC_TDCR, TDCR_DIV16);
+  lapic_write (LAPIC_TIMER, TIMER_PERIODIC | LAPIC_VEC_TIMER);
+  lapic_write (LAPIC_TICR, timer_count);
+  lapic_eoi ();
+}
+
+/* Returns the local APIC ID of the running CPU. */
+uint8_t
+lapic_id (void)
+{
+  return lapic_read (LAPIC_ID) >> 24;
+}
+
+/* Acknowledges the interrupt being serviced.  Without this, the
+   local APIC would not deliver any interrupt of equal or lower
+   priority to us again. */
+void
+lapic_eoi (void)
+{
+  lapic_write (LAPIC_EOI, 0);
+}
+
+/* Sends interrupt VEC to the CPU whose local APIC ID is
+   APIC_ID. */
+void
+lapic_send_ipi (uint8_t apic_id, uint8_t vec)
+{
+  send_icr (apic_id, vec);
+}
+
+/* Boots the application processor whose local APIC ID is
+   APIC_ID, making it start in real mode at physical address
+   PADDR, which must be page-aligned and below 1 MB.  This is the
+   INIT-SIPI-SIPI sequence of [MP] appendix B.4. */
+void
+lapic_start_ap (uint8_t apic_id, uint32_t paddr)
+{
+  uint16_t *warm_reset = ptov (WARM_RESET_VECTOR);
+  int i;
+
+  ASSERT (paddr % PGSIZE == 0 && paddr < 0x100000);
+
+  /* Older CPUs take the warm reset vector out of INIT. */
+  outb (CMOS_REG_SET, CMOS_SHUTDOWN);
+  outb (CMOS_REG_IO, 0x0a);
+  warm_reset[0] = 0;
+  warm_reset[1] = paddr >> 4;
+
+  send_icr (apic_id, ICR_INIT | ICR_LEVEL | ICR_ASSERT);
+  timer_udelay (200);
+  send_icr (apic_id, ICR_INIT | ICR_LEVEL);
+  timer_udelay (100);
+
+  /* Newer CPUs ignore INIT's reset vector and instead start at
+     the page given in a startup IPI, which must be sent twice. */
+  for (i = 0; i < 2; i++)
+    {
+      send_icr (apic_id, ICR_STARTUP | (paddr >> 12));
+      timer_udelay (200);
+    }
+}
+
+/* Measures how fast the local APIC timer counts, in terms of
+   PIT timer ticks, so that application processors can run
+   their timers at TIMER_FREQ.  Interrupts must be on. */
+void
+lapic_timer_calibrate (void)
+{
+  int64_t start;
+
+  lapic_write (LAPIC_TDCR, TDCR_DIV16);
+  lapic_write (LAPIC_TIMER, LVT_MASKED | LAPIC_VEC_TIMER);
+
+  /* Count down through exactly one timer tick. */
+  start = timer_ticks ();
+  while (timer_ticks () == start)
+    barrier ();
+  lapic_write (LAPIC_TICR, UINT32_MAX);
+  start = timer_ticks ();
+  while (timer_ticks () == start)
+    barrier ();
+  timer_count = UINT32_MAX - lapic_read (LAPIC_TCCR);
+  lapic_write (LAPIC_TICR, 0);
+}
@@ -0,0 +1,24 @@
+#ifndef DEVICES_LAPIC_H
+#define DEVICES_LAPIC_H
+
+#include <stdint.h>
+
+/* Interrupt vectors raised by the local APIC.  Vectors
+   LAPIC_VEC_FIRST...LAPIC_VEC_SPURIOUS - 1 are handled like the
+   PIC's external interrupts, except that they are acknowledged
+   on the local APIC. */
+#define LAPIC_VEC_FIRST         0x40
+#define LAPIC_VEC_TIMER         0x40    /* Per-CPU timer. */
+#define LAPIC_VEC_RESCHEDULE    0x41    /* Reschedule IPI. */
+#define LAPIC_VEC_TLB           0x42    /* TLB shootdown IPI. */
+#define LAPIC_VEC_SPURIOUS      0x4f    /* Spurious; never acknowledged. */
+
+void lapic_init (uint32_t paddr);
+void lapic_init_ap (void);
+uint8_t lapic_id (void);
+void lapic_eoi (void);
+void lapic_send_ipi (uint8_t apic_id, uint8_t vec);
+void lapic_start_ap (uint8_t apic_id, uint32_t paddr);
+void lapic_timer_calibrate (void);
+
+#endif /* devices/lapic.h */
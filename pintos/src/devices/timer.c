@@ -4,7 +4,11 @@
 #include <round.h>
 #include <stdio.h>
 #include "devices/pit.h"
+#include "devices/rtc.h"
 #include "threads/interrupt.h"
+#include "threads/io.h"
+#include "threads/smp.h"
+#include "threads/spinlock.h"
 #include "threads/synch.h"
 #include "threads/thread.h"
 
@@ -20,50 +24,140 @@
 /* Number of timer ticks since OS booted. */
 static int64_t ticks;
 
-/* Number of loops per timer tick.
-   Initialized by timer_calibrate(). */
-static unsigned loops_per_tick;
+/* PIT cycles per timer tick, as loaded by pit_configure_channel(). */
+#define PIT_TICK_COUNT ((PIT_HZ + TIMER_FREQ / 2) / TIMER_FREQ)
+
+/* Tickless idle.
+
+   When the idle thread is about to halt, timer_idle_enter()
+   replaces the periodic interrupt with a PIT one-shot timed to
+   the tick boundary at which the earliest sleeper is due, so an
+   idle CPU is not woken TIMER_FREQ times a second for nothing.
+   The 16-bit PIT counter bounds a one-shot to
+   PIT_COUNT_MAX / PIT_TICK_COUNT ticks, so longer idle periods
+   take several one-shots.
+
+   The one-shot always ends exactly on a tick boundary, so when
+   it fires timer_interrupt() accounts for the skipped ticks and
+   resumes periodic mode in phase.  If some other interrupt ends
+   the idle period first, timer_idle_exit() accounts for the
+   whole ticks that have passed and rearms the one-shot for the
+   next tick boundary, which again resumes periodic mode.  Each
+   skipped tick is replayed through thread_tick(), so idle_ticks
+   and the MLFQS bookkeeping see every tick.
+
+   Tickless mode is only used while a single CPU runs: once
+   other CPUs are up, a thread on one of them could go to sleep
+   until before the armed one-shot ends. */
+bool timer_tickless;
+static int64_t oneshot_ticks;   /* Ticks the armed one-shot spans, or 0. */
+static unsigned oneshot_count;  /* PIT cycles the armed one-shot spans. */
+static unsigned oneshot_first;  /* PIT cycles to its first tick boundary. */
+
+/* Nanoseconds per timer tick, as the PIT actually runs it. */
+#define NS_PER_SEC 1000000000
+#define TICK_NS ((int64_t) PIT_TICK_COUNT * NS_PER_SEC / PIT_HZ)
+
+/* TSC clocksource.
+
+   timer_calibrate() counts how many TSC cycles the CPU runs
+   through in a few PIT ticks.  After that, timer_nanoseconds()
+   is the time at calibration plus the TSC cycles since then,
+   converted to nanoseconds by a fixed-point multiply: NS =
+   CYCLES * tsc_mult / 2**tsc_shift, with tsc_shift as large as
+   lets tsc_mult fit in 32 bits.  Nothing in the clocksource
+   changes after calibration, so reading it takes no lock.
+
+   We assume that the TSCs of all CPUs run at the same rate and
+   in step, as they do on current hardware and in emulators. */
+#define CALIBRATE_TICKS ((TIMER_FREQ + 9) / 10)
+static uint64_t tsc_hz;         /* TSC cycles per second, or 0. */
+static uint64_t tsc_base;       /* TSC at calibration. */
+static int64_t ns_base;         /* timer_nanoseconds() at calibration. */
+static uint32_t tsc_mult;       /* Cycles to nanoseconds multiplier... */
+static int tsc_shift;           /* ...and shift. */
+static int64_t realtime_base;   /* Unix time at boot, in nanoseconds. */
+
+/* Sub-tick sleeps.
+
+   A sleep is rounded down to whole timer ticks, slept on
+   sleep_list, and the rest, if there is more than SPIN_NS of
+   it, slept on hrsleep_list until a given timer_nanoseconds().
+   No interrupt marks such a deadline, so hrsleep_list is checked
+   on every timer tick and, continuously, by idle CPUs, which
+   keep polling instead of halting while it is not empty.  Thus
+   a sleeper is woken as soon as its deadline passes if a CPU is
+   free, and at worst on the next tick if all are busy.  Waits
+   shorter than SPIN_NS, where blocking would cost more than it
+   saves, spin on the TSC. */
+#define SPIN_NS 2000
+static struct list hrsleep_list;
+
+/* List of threads blocked in timer_sleep(), in ascending order
+   of wakeup_tick.  Threads with equal deadlines keep the order
+   in which they went to sleep.  Accessed only with interrupts
+   off, since timer_interrupt() pops from it. */
+static struct list sleep_list;
 
 static intr_handler_func timer_interrupt;
-static bool too_many_loops (unsigned loops);
-static void busy_wait (int64_t loops);
+static void timer_advance (int64_t);
+static void hrsleep_wake (void);
+static bool wakeup_less (const struct list_elem *, const struct list_elem *,
+                         void *aux);
+static bool wakeup_ns_less (const struct list_elem *,
+                            const struct list_elem *, void *aux);
+static int64_t real_time_ns (int64_t num, int32_t denom);
 static void real_time_sleep (int64_t num, int32_t denom);
 static void real_time_delay (int64_t num, int32_t denom);
+static void spin_until (int64_t deadline);
 
 /* Sets up the timer to interrupt TIMER_FREQ times per second,
    and registers the corresponding interrupt. */
 void
 timer_init (void)
 {
+  list_init (&sleep_list);
+  list_init (&hrsleep_list);
   pit_configure_channel (0, 2, TIMER_FREQ);
   intr_register_ext (0x20, timer_interrupt, "8254 Timer");
 }
 
-/* Calibrates loops_per_tick, used to implement brief delays. */
+/* Calibrates the TSC clocksource against the PIT. */
 void
 timer_calibrate (void)
 {
-  unsigned high_bit, test_bit;
+  int64_t start;
+  uint64_t tsc_start, cycles, mult;
 
   ASSERT (intr_get_level () == INTR_ON);
   printf ("Calibrating timer...  ");
 
-  /* Approximate loops_per_tick as the largest power-of-two
-     still less than one timer tick. */
-  loops_per_tick = 1u << 10;
-  while (!too_many_loops (loops_per_tick << 1))
+  /* Count TSC cycles from one tick boundary to another
+     CALIBRATE_TICKS later. */
+  start = ticks;
+  while (ticks == start)
+    barrier ();
+  start = ticks;
+  tsc_start = rdtsc ();
+  while (ticks < start + CALIBRATE_TICKS)
+    barrier ();
+  cycles = rdtsc () - tsc_start;
+
+  /* Find the largest shift whose multiplier fits in 32 bits. */
+  for (tsc_shift = 32; ; tsc_shift--)
     {
-      loops_per_tick <<= 1;
-      ASSERT (loops_per_tick != 0);
+      mult = ((uint64_t) (CALIBRATE_TICKS * TICK_NS) << tsc_shift) / cycles;
+      if (mult <= UINT32_MAX || tsc_shift == 0)
+        break;
     }
-
-  /* Refine the next 8 bits of loops_per_tick. */
-  high_bit = loops_per_tick;
-  for (test_bit = high_bit >> 1; test_bit != high_bit >> 10; test_bit >>= 1)
-    if (!too_many_loops (high_bit | test_bit))
-      loops_per_tick |= test_bit;
-
-  printf ("%'"PRIu64" loops/s.\n", (uint64_t) loops_per_tick * TIMER_FREQ);
+  tsc_mult = mult;
+  tsc_base = tsc_start;
+  ns_base = start * TICK_NS;
+  tsc_hz = cycles * NS_PER_SEC / (CALIBRATE_TICKS * TICK_NS);
+  realtime_base = (int64_t) rtc_get_time () * NS_PER_SEC
+                  - timer_nanoseconds ();
+
+  printf ("%'"PRIu64" TSC cycles/s.\n", tsc_hz);
 }
 
 /* Returns the number of timer ticks since the OS booted. */
@@ -84,20 +178,67 @@ timer_elapsed (int64_t then)
   return timer_ticks () - then;
 }
 
+/* Returns the number of nanoseconds since the OS booted.  Until
+   timer_calibrate() has run, this has only the resolution of a
+   timer tick.  Interrupts need not be turned on. */
+int64_t
+timer_nanoseconds (void)
+{
+  if (tsc_hz == 0)
+    return timer_ticks () * TICK_NS;
+  return ns_base + timer_cycles_to_ns (rdtsc () - tsc_base);
+}
+
+/* Converts CYCLES, a span of TSC cycles, to nanoseconds.
+   Returns 0 until timer_calibrate() has run.  Does not touch
+   the interrupt level, so the interrupt code may call it. */
+int64_t
+timer_cycles_to_ns (uint64_t cycles)
+{
+  /* Multiply the 64-bit cycle count by tsc_mult in two 32-bit
+     halves, so that the product cannot overflow. */
+  return ((((uint64_t) (uint32_t) (cycles >> 32) * tsc_mult)
+           << (32 - tsc_shift))
+          + (((uint64_t) (uint32_t) cycles * tsc_mult) >> tsc_shift));
+}
+
+/* Returns the number of nanoseconds since the Unix epoch, with
+   the real-time clock's reading at calibration as the starting
+   point. */
+int64_t
+timer_realtime (void)
+{
+  return realtime_base + timer_nanoseconds ();
+}
+
 /* Sleeps for approximately TICKS timer ticks.  Interrupts must
-   be turned on. */
+   be turned on.
+
+   The calling thread is blocked on sleep_list rather than kept
+   on the run queue, so it costs nothing until timer_interrupt()
+   finds its deadline has passed. */
 void
 timer_sleep (int64_t ticks)
 {
-  int64_t start = timer_ticks ();
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
 
   ASSERT (intr_get_level () == INTR_ON);
-  while (timer_elapsed (start) < ticks)
-    thread_yield ();
+  if (ticks <= 0)
+    return;
+
+  old_level = intr_disable ();
+  cur->wakeup_tick = timer_ticks () + ticks;
+  list_insert_ordered (&sleep_list, &cur->elem, wakeup_less, NULL);
+  thread_block ();
+  intr_set_level (old_level);
 }
 
 /* Sleeps for approximately MS milliseconds.  Interrupts must be
-   turned on. */
+   turned on.
+
+   This and the following sleep functions keep to nanosecond
+   precision, as explained above for hrsleep_list. */
 void
 timer_msleep (int64_t ms)
 {
@@ -152,13 +293,103 @@ timer_udelay (int64_t us)
    Busy waiting wastes CPU cycles, and busy waiting with
    interrupts off for the interval between timer ticks or longer
    will cause timer ticks to be lost.  Thus, use timer_nsleep()
-   instead if interrupts are enabled.*/
+   instead if interrupts are enabled. */
 void
 timer_ndelay (int64_t ns)
 {
   real_time_delay (ns, 1000 * 1000 * 1000);
 }
 
+/* Called by the idle thread, with interrupts off, just before it
+   halts the CPU.  In tickless mode, stops the periodic timer
+   interrupt until the next sleeper is due, or a throttled thread
+   may run again, if that is more than one tick away.  Does
+   nothing once more than one CPU runs. */
+void
+timer_idle_enter (void)
+{
+  int64_t span = PIT_COUNT_MAX / PIT_TICK_COUNT;
+  int64_t release;
+  unsigned first;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (!timer_tickless || smp_active || oneshot_ticks != 0)
+    return;
+
+  if (!list_empty (&sleep_list))
+    {
+      struct thread *t = list_entry (list_front (&sleep_list),
+                                     struct thread, elem);
+      if (t->wakeup_tick - ticks < span)
+        span = t->wakeup_tick - ticks;
+    }
+  release = thread_next_release ();
+  if (release - ticks < span)
+    span = release - ticks;
+  if (span <= 1)
+    return;
+
+  /* The periodic counter says how far away the next tick
+     boundary is; the one-shot ends SPAN boundaries from
+     now. */
+  first = pit_read_counter (0);
+  if (first == 0 || first > PIT_TICK_COUNT)
+    first = PIT_TICK_COUNT;
+  oneshot_first = first;
+  oneshot_count = first + (span - 1) * PIT_TICK_COUNT;
+  oneshot_ticks = span;
+  pit_start_oneshot (0, oneshot_count);
+}
+
+/* Called by the idle thread, with interrupts off, after the CPU
+   has been woken by an interrupt.  If that interrupt was not the
+   one-shot armed by timer_idle_enter(), accounts for the ticks
+   that have passed since and shortens the one-shot to end at the
+   next tick boundary, where timer_interrupt() resumes periodic
+   mode. */
+void
+timer_idle_exit (void)
+{
+  unsigned elapsed;
+  int64_t passed;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (oneshot_ticks <= 1)
+    return;
+
+  elapsed = oneshot_count - pit_read_counter (0);
+  if (elapsed >= oneshot_count)
+    {
+      /* The one-shot has expired and its interrupt is pending.
+         Leave the accounting to timer_interrupt(). */
+      return;
+    }
+
+  passed = elapsed < oneshot_first
+           ? 0 : 1 + (elapsed - oneshot_first) / PIT_TICK_COUNT;
+  oneshot_first += passed * PIT_TICK_COUNT - elapsed;
+  oneshot_count = oneshot_first;
+  oneshot_ticks = 1;
+  pit_start_oneshot (0, oneshot_count);
+  timer_advance (passed);
+}
+
+/* Called by the idle thread, with interrupts off, before it
+   halts the CPU.  Wakes every thread in hrsleep_list whose
+   deadline has passed, and returns true if any other remain, in
+   which case the idle thread should poll again instead of
+   halting. */
+bool
+timer_idle_poll (void)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  hrsleep_wake ();
+  return !list_empty (&hrsleep_list);
+}
+
 /* Prints timer statistics. */
 void
 timer_print_stats (void)
@@ -170,77 +401,150 @@ timer_print_stats (void)
 static void
 timer_interrupt (struct intr_frame *args UNUSED)
 {
-  ticks++;
-  thread_tick ();
+  if (oneshot_ticks != 0)
+    {
+      /* A tickless one-shot ended on a tick boundary.  Resume
+         periodic interrupts from here and account for every tick
+         the one-shot spanned. */
+      int64_t passed = oneshot_ticks;
+      oneshot_ticks = 0;
+      pit_configure_channel (0, 2, TIMER_FREQ);
+      timer_advance (passed);
+    }
+  else
+    timer_advance (1);
 }
 
-/* Returns true if LOOPS iterations waits for more than one timer
-   tick, otherwise false. */
-static bool
-too_many_loops (unsigned loops)
+/* Advances the tick count by N ticks, waking sleepers and
+   running thread_tick() for each one. */
+static void
+timer_advance (int64_t n)
 {
-  /* Wait for a timer tick. */
-  int64_t start = ticks;
-  while (ticks == start)
-    barrier ();
+  ASSERT (intr_get_level () == INTR_OFF);
 
-  /* Run LOOPS loops. */
-  start = ticks;
-  busy_wait (loops);
+  while (n-- > 0)
+    {
+      ticks++;
+
+      /* Wake every sleeper whose deadline has passed.  sleep_list
+         is sorted, so on ticks where nothing expires this is a
+         single comparison against the front element. */
+      while (!list_empty (&sleep_list))
+        {
+          struct thread *t = list_entry (list_front (&sleep_list),
+                                         struct thread, elem);
+          if (t->wakeup_tick > ticks)
+            break;
+          list_pop_front (&sleep_list);
+          thread_unblock (t);
+        }
+      hrsleep_wake ();
+
+      thread_tick ();
+    }
+}
 
-  /* If the tick count changed, we iterated too long. */
-  barrier ();
-  return start != ticks;
+/* Returns true if the thread owning A wakes up strictly before
+   the thread owning B. */
+static bool
+wakeup_less (const struct list_elem *a, const struct list_elem *b,
+             void *aux UNUSED)
+{
+  return list_entry (a, struct thread, elem)->wakeup_tick
+         < list_entry (b, struct thread, elem)->wakeup_tick;
 }
 
-/* Iterates through a simple loop LOOPS times, for implementing
-   brief delays.
+/* Wakes every thread in hrsleep_list whose deadline has
+   passed. */
+static void
+hrsleep_wake (void)
+{
+  int64_t now;
+
+  ASSERT (intr_get_level () == INTR_OFF);
 
-   Marked NO_INLINE because code alignment can significantly
-   affect timings, so that if this function was inlined
-   differently in different places the results would be difficult
-   to predict. */
-static void NO_INLINE
-busy_wait (int64_t loops)
+  if (list_empty (&hrsleep_list))
+    return;
+  now = timer_nanoseconds ();
+  while (!list_empty (&hrsleep_list))
+    {
+      struct thread *t = list_entry (list_front (&hrsleep_list),
+                                     struct thread, elem);
+      if (t->wakeup_ns > now)
+        break;
+      list_pop_front (&hrsleep_list);
+      thread_unblock (t);
+    }
+}
+
+/* Returns true if the thread owning A has an earlier
+   nanosecond deadline than the thread owning B. */
+static bool
+wakeup_ns_less (const struct list_elem *a, const struct list_elem *b,
+                void *aux UNUSED)
 {
-  while (loops-- > 0)
-    barrier ();
+  return list_entry (a, struct thread, elem)->wakeup_ns
+         < list_entry (b, struct thread, elem)->wakeup_ns;
 }
 
-/* Sleep for approximately NUM/DENOM seconds. */
+/* Sleep for approximately NUM/DENOM seconds: whole ticks with
+   timer_sleep(), then the rest on hrsleep_list, then, for the
+   last few microseconds, by spinning. */
 static void
 real_time_sleep (int64_t num, int32_t denom)
 {
-  /* Convert NUM/DENOM seconds into timer ticks, rounding down.
-
-        (NUM / DENOM) s
-     ---------------------- = NUM * TIMER_FREQ / DENOM ticks.
-     1 s / TIMER_FREQ ticks
-  */
-  int64_t ticks = num * TIMER_FREQ / denom;
+  int64_t deadline, left;
 
   ASSERT (intr_get_level () == INTR_ON);
-  if (ticks > 0)
+  if (num <= 0)
+    return;
+
+  /* timer_sleep(N) wakes up at the Nth tick boundary from now,
+     so it never overshoots a deadline at least N ticks away. */
+  deadline = timer_nanoseconds () + real_time_ns (num, denom);
+  left = deadline - timer_nanoseconds ();
+  if (left >= TICK_NS)
+    timer_sleep (left / TICK_NS);
+
+  left = deadline - timer_nanoseconds ();
+  if (left >= SPIN_NS && tsc_hz != 0)
     {
-      /* We're waiting for at least one full timer tick.  Use
-         timer_sleep() because it will yield the CPU to other
-         processes. */
-      timer_sleep (ticks);
-    }
-  else
-    {
-      /* Otherwise, use a busy-wait loop for more accurate
-         sub-tick timing. */
-      real_time_delay (num, denom);
+      struct thread *cur = thread_current ();
+      enum intr_level old_level = intr_disable ();
+      cur->wakeup_ns = deadline;
+      list_insert_ordered (&hrsleep_list, &cur->elem, wakeup_ns_less, NULL);
+      thread_block ();
+      intr_set_level (old_level);
     }
+
+  spin_until (deadline);
 }
 
 /* Busy-wait for approximately NUM/DENOM seconds. */
 static void
 real_time_delay (int64_t num, int32_t denom)
+{
+  spin_until (timer_nanoseconds () + real_time_ns (num, denom));
+}
+
+/* Converts NUM/DENOM seconds into nanoseconds. */
+static int64_t
+real_time_ns (int64_t num, int32_t denom)
 {
   /* Scale the numerator and denominator down by 1000 to avoid
      the possibility of overflow. */
   ASSERT (denom % 1000 == 0);
-  busy_wait (loops_per_tick * num / 1000 * TIMER_FREQ / (denom / 1000));
+  return num * (NS_PER_SEC / 1000) / (denom / 1000);
+}
+
+/* Spins until timer_nanoseconds() reaches DEADLINE.  Returns at
+   once if the TSC has not been calibrated yet, since then time
+   may not advance with interrupts off. */
+static void
+spin_until (int64_t deadline)
+{
+  if (tsc_hz == 0)
+    return;
+  while (timer_nanoseconds () < deadline)
+    cpu_relax ();
 }
@@ -0,0 +1,55 @@
+/* futex-bench.c
+
+   Measures the cost of an uncontended lock/unlock pair on a
+   futex-based mutex, which stays in user space, against a
+   kernel-entry-per-operation baseline of the kind a
+   semaphore system call would need.  The baseline makes two
+   futex_wake calls that wake nobody, so it pays for the trap
+   and the futex lookup but no scheduling. */
+
+#include <mutex.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <syscall.h>
+
+/* Lock/unlock pairs per measurement. */
+#define ITERATIONS 100000
+
+static inline uint64_t
+rdtsc (void)
+{
+  uint64_t tsc;
+  asm volatile ("rdtsc" : "=A" (tsc));
+  return tsc;
+}
+
+int
+main (void)
+{
+  struct mutex m;
+  uint64_t start, mutex_cycles, syscall_cycles;
+  int i;
+
+  mutex_init (&m);
+  start = rdtsc ();
+  for (i = 0; i < ITERATIONS; i++)
+    {
+      mutex_lock (&m);
+      mutex_unlock (&m);
+    }
+  mutex_cycles = rdtsc () - start;
+
+  start = rdtsc ();
+  for (i = 0; i < ITERATIONS; i++)
+    {
+      futex_wake (&m.state, 1);
+      futex_wake (&m.state, 1);
+    }
+  syscall_cycles = rdtsc () - start;
+
+  printf ("futex mutex:      %llu cycles per lock/unlock\n",
+          mutex_cycles / ITERATIONS);
+  printf ("syscall baseline: %llu cycles per lock/unlock\n",
+          syscall_cycles / ITERATIONS);
+  return EXIT_SUCCESS;
+}
@@ -5,7 +5,11 @@
 #include <string.h>
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
+#include "threads/interrupt.h"
 #include "threads/malloc.h"
+#include "threads/slab.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
 
 /* Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
@@ -41,6 +45,7 @@ struct inode
     int open_cnt;                       /* Number of openers. */
     bool removed;                       /* True if deleted, false otherwise. */
     int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
+    struct rwlock rwlock;               /* See inode_read_lock(). */
     struct inode_disk data;             /* Inode content. */
   };
 
@@ -59,14 +64,36 @@ byte_to_sector (const struct inode *inode, off_t pos)
 }
 
 /* List of open inodes, so that opening a single inode twice
-   returns the same `struct inode'. */
+   returns the same `struct inode'.  Opening an inode that is
+   already open, by far the common case, only needs to search
+   the list, so it holds open_inodes_lock for reading; adding
+   and removing inodes hold it for writing. */
 static struct list open_inodes;
+static struct rwlock open_inodes_lock;
+
+/* Cache of in-memory inodes, whose constructor initializes their
+   rwlocks. */
+static struct kmem_cache *inode_cache;
+
+static struct inode *find_open_inode (block_sector_t);
+static kmem_ctor_func inode_ctor;
 
 /* Initializes the inode module. */
 void
 inode_init (void)
 {
   list_init (&open_inodes);
+  rwlock_init (&open_inodes_lock);
+  inode_cache = kmem_cache_create ("inode", sizeof (struct inode),
+                                   inode_ctor, NULL);
+}
+
+/* Constructs INODE_, an object in inode_cache. */
+static void
+inode_ctor (void *inode_)
+{
+  struct inode *inode = inode_;
+  rwlock_init (&inode->rwlock);
 }
 
 /* Initializes an inode with LENGTH bytes of data and
@@ -101,7 +128,10 @@ inode_create (block_sector_t sector, off_t length)
               size_t i;
 
               for (i = 0; i < sectors; i++)
-                block_write (fs_device, disk_inode->start + i, zeros);
+                {
+                  block_write (fs_device, disk_inode->start + i, zeros);
+                  cond_resched ();
+                }
             }
           success = true;
         }
@@ -116,25 +146,26 @@ inode_create (block_sector_t sector, off_t length)
 struct inode *
 inode_open (block_sector_t sector)
 {
-  struct list_elem *e;
   struct inode *inode;
 
   /* Check whether this inode is already open. */
-  for (e = list_begin (&open_inodes); e != list_end (&open_inodes);
-       e = list_next (e))
-    {
-      inode = list_entry (e, struct inode, elem);
-      if (inode->sector == sector)
-        {
-          inode_reopen (inode);
-          return inode;
-        }
-    }
+  rwlock_acquire_read (&open_inodes_lock);
+  inode = inode_reopen (find_open_inode (sector));
+  rwlock_release_read (&open_inodes_lock);
+  if (inode != NULL)
+    return inode;
+
+  /* Not open, so add it, unless another thread beat us to it
+     while we did not hold the lock. */
+  rwlock_acquire_write (&open_inodes_lock);
+  inode = inode_reopen (find_open_inode (sector));
+  if (inode != NULL)
+    goto done;
 
   /* Allocate memory. */
-  inode = malloc (sizeof *inode);
+  inode = kmem_cache_alloc (inode_cache);
   if (inode == NULL)
-    return NULL;
+    goto done;
 
   /* Initialize. */
   list_push_front (&open_inodes, &inode->elem);
@@ -143,15 +174,42 @@ inode_open (block_sector_t sector)
   inode->deny_write_cnt = 0;
   inode->removed = false;
   block_read (fs_device, inode->sector, &inode->data);
+
+ done:
+  rwlock_release_write (&open_inodes_lock);
   return inode;
 }
 
-/* Reopens and returns INODE. */
+/* Returns the open inode for SECTOR, or a null pointer if there
+   is none.  open_inodes_lock must be held. */
+static struct inode *
+find_open_inode (block_sector_t sector)
+{
+  struct list_elem *e;
+
+  for (e = list_begin (&open_inodes); e != list_end (&open_inodes);
+       e = list_next (e))
+    {
+      struct inode *inode = list_entry (e, struct inode, elem);
+      if (inode->sector == sector)
+        return inode;
+    }
+  return NULL;
+}
+
+/* Reopens and returns INODE.
+
+   Several readers of open_inodes may reopen the same inode at
+   once, so open_cnt is only changed with interrupts off. */
 struct inode *
 inode_reopen (struct inode *inode)
 {
   if (inode != NULL)
-    inode->open_cnt++;
+    {
+      enum intr_level old_level = intr_disable ();
+      inode->open_cnt++;
+      intr_set_level (old_level);
+    }
   return inode;
 }
 
@@ -168,15 +226,26 @@ inode_get_inumber (const struct inode *inode)
 void
 inode_close (struct inode *inode)
 {
+  enum intr_level old_level;
+  int open_cnt;
+
   /* Ignore null pointer. */
   if (inode == NULL)
     return;
 
+  /* Holding open_inodes_lock for writing keeps anyone from
+     finding and reopening INODE once its count drops to 0. */
+  rwlock_acquire_write (&open_inodes_lock);
+  old_level = intr_disable ();
+  open_cnt = --inode->open_cnt;
+  intr_set_level (old_level);
+
   /* Release resources if this was the last opener. */
-  if (--inode->open_cnt == 0)
+  if (open_cnt == 0)
     {
       /* Remove from inode list and release lock. */
       list_remove (&inode->elem);
+      rwlock_release_write (&open_inodes_lock);
 
       /* Deallocate blocks if removed. */
       if (inode->removed)
@@ -186,8 +255,10 @@ inode_close (struct inode *inode)
                             bytes_to_sectors (inode->data.length));
         }
 
-      free (inode);
+      kmem_cache_free (inode_cache, inode);
     }
+  else
+    rwlock_release_write (&open_inodes_lock);
 }
 
 /* Marks INODE to be deleted when it is closed by the last caller who
@@ -342,6 +413,37 @@ inode_allow_write (struct inode *inode)
   inode->deny_write_cnt--;
 }
 
+/* Acquires INODE's readers-writer lock for reading.  The inode
+   module does not use this lock itself; it serializes the
+   users of an inode's contents that need it, such as
+   directories, while letting readers proceed together. */
+void
+inode_read_lock (struct inode *inode)
+{
+  rwlock_acquire_read (&inode->rwlock);
+}
+
+/* Releases INODE's readers-writer lock, held for reading. */
+void
+inode_read_unlock (struct inode *inode)
+{
+  rwlock_release_read (&inode->rwlock);
+}
+
+/* Acquires INODE's readers-writer lock for writing. */
+void
+inode_write_lock (struct inode *inode)
+{
+  rwlock_acquire_write (&inode->rwlock);
+}
+
+/* Releases INODE's readers-writer lock, held for writing. */
+void
+inode_write_unlock (struct inode *inode)
+{
+  rwlock_release_write (&inode->rwlock);
+}
+
 /* Returns the length, in bytes, of INODE's data. */
 off_t
 inode_length (const struct inode *inode)
@@ -4,6 +4,7 @@
 #include <round.h>
 #include <stdio.h>
 #include "threads/malloc.h"
+#include "threads/thread.h"
 #ifdef FILESYS
 #include "filesys/file.h"
 #endif
@@ -21,6 +22,10 @@ typedef unsigned long elem_type;
 /* Number of bits in an element. */
 #define ELEM_BITS (sizeof (elem_type) * CHAR_BIT)
 
+/* Number of starting positions bitmap_scan() tries between
+   preemption points.  A power of 2, so checking is cheap. */
+#define SCAN_RESCHED_INTERVAL 4096
+
 /* From the outside, a bitmap is an array of bits.  From the
    inside, it's an array of elem_type (defined above) that
    simulates an array of bits. */
@@ -303,8 +308,12 @@ bitmap_scan (const struct bitmap *b, size_t start, size_t cnt, bool value)
       size_t last = b->bit_cnt - cnt;
       size_t i;
       for (i = start; i <= last; i++)
-        if (!bitmap_contains (b, i, cnt, !value))
-          return i;
+        {
+          if (!bitmap_contains (b, i, cnt, !value))
+            return i;
+          if (i % SCAN_RESCHED_INTERVAL == SCAN_RESCHED_INTERVAL - 1)
+            cond_resched ();
+        }
     }
   return BITMAP_ERROR;
 }
@@ -0,0 +1,229 @@
+#include "heap.h"
+#include "../debug.h"
+
+/* A pairing heap is a tree in which every element is greater
+   than or equal to its children.  The children of an element
+   form a doubly linked list starting at its `child' member and
+   continuing through their `next' members.  Each child's `prev'
+   member points to its left sibling, except that the leftmost
+   child's points to the parent instead.  The root has no
+   siblings and a null `prev'. */
+
+static bool before (const struct heap *,
+                    const struct heap_elem *, const struct heap_elem *);
+static struct heap_elem *meld (const struct heap *,
+                               struct heap_elem *, struct heap_elem *);
+static struct heap_elem *merge_pairs (const struct heap *,
+                                      struct heap_elem *first);
+static void insert (struct heap *, struct heap_elem *);
+static void detach (struct heap *, struct heap_elem *);
+
+/* Initializes HEAP as an empty heap ordered by LESS given
+   auxiliary data AUX. */
+void
+heap_init (struct heap *heap, heap_less_func *less, void *aux)
+{
+  ASSERT (heap != NULL);
+  ASSERT (less != NULL);
+
+  heap->root = NULL;
+  heap->size = 0;
+  heap->next_seq = 0;
+  heap->less = less;
+  heap->aux = aux;
+}
+
+/* Inserts ELEM into HEAP. */
+void
+heap_push (struct heap *heap, struct heap_elem *elem)
+{
+  ASSERT (heap != NULL);
+  ASSERT (elem != NULL);
+
+  elem->seq = heap->next_seq++;
+  insert (heap, elem);
+  heap->size++;
+}
+
+/* Returns the greatest element in HEAP, or a null pointer if
+   HEAP is empty.  Of several greatest elements, returns the one
+   pushed first. */
+struct heap_elem *
+heap_max (struct heap *heap)
+{
+  ASSERT (heap != NULL);
+
+  return heap->root;
+}
+
+/* Removes the greatest element from HEAP and returns it.  HEAP
+   must not be empty. */
+struct heap_elem *
+heap_pop_max (struct heap *heap)
+{
+  struct heap_elem *max;
+
+  ASSERT (heap != NULL);
+  ASSERT (!heap_empty (heap));
+
+  max = heap->root;
+  heap->root = merge_pairs (heap, max->child);
+  heap->size--;
+  return max;
+}
+
+/* Removes ELEM, which must be in HEAP, from HEAP. */
+void
+heap_remove (struct heap *heap, struct heap_elem *elem)
+{
+  ASSERT (heap != NULL);
+  ASSERT (elem != NULL);
+  ASSERT (!heap_empty (heap));
+
+  detach (heap, elem);
+  heap->size--;
+}
+
+/* Moves ELEM, which must be in HEAP, to its proper place after
+   the value that HEAP is ordered by has changed for ELEM.  ELEM
+   keeps its place relative to elements that compare equal to
+   it. */
+void
+heap_update (struct heap *heap, struct heap_elem *elem)
+{
+  ASSERT (heap != NULL);
+  ASSERT (elem != NULL);
+
+  detach (heap, elem);
+  insert (heap, elem);
+}
+
+/* Returns the number of elements in HEAP. */
+size_t
+heap_size (struct heap *heap)
+{
+  ASSERT (heap != NULL);
+
+  return heap->size;
+}
+
+/* Returns true if HEAP is empty, false otherwise. */
+bool
+heap_empty (struct heap *heap)
+{
+  ASSERT (heap != NULL);
+
+  return heap->root == NULL;
+}
+
+/* Returns true if A should come out of HEAP before B, that is,
+   if A is greater than B or equal to it but pushed earlier. */
+static bool
+before (const struct heap *heap,
+        const struct heap_elem *a, const struct heap_elem *b)
+{
+  if (heap->less (b, a, heap->aux))
+    return true;
+  else if (heap->less (a, b, heap->aux))
+    return false;
+  else
+    return (int) (a->seq - b->seq) < 0;
+}
+
+/* Combines the trees rooted at A and B, neither of which may
+   have siblings, and returns the root of the result. */
+static struct heap_elem *
+meld (const struct heap *heap, struct heap_elem *a, struct heap_elem *b)
+{
+  if (before (heap, b, a))
+    {
+      struct heap_elem *t = a;
+      a = b;
+      b = t;
+    }
+
+  /* Make B the leftmost child of A. */
+  b->next = a->child;
+  if (b->next != NULL)
+    b->next->prev = b;
+  b->prev = a;
+  a->child = b;
+  return a;
+}
+
+/* Combines the list of sibling trees that starts at FIRST into
+   one tree and returns its root, or a null pointer if FIRST is
+   null.  This is the usual two-pass pairing: meld the trees in
+   pairs from left to right, then meld the pairs from right to
+   left into a single tree. */
+static struct heap_elem *
+merge_pairs (const struct heap *heap, struct heap_elem *first)
+{
+  struct heap_elem *pairs = NULL;
+  struct heap_elem *root = NULL;
+
+  /* First pass.  PAIRS is a stack, linked through `next', of
+     the melded pairs, rightmost on top. */
+  while (first != NULL)
+    {
+      struct heap_elem *a = first;
+      struct heap_elem *b = a->next;
+
+      first = b != NULL ? b->next : NULL;
+      a->next = a->prev = NULL;
+      if (b != NULL)
+        {
+          b->next = b->prev = NULL;
+          a = meld (heap, a, b);
+        }
+      a->next = pairs;
+      pairs = a;
+    }
+
+  /* Second pass. */
+  while (pairs != NULL)
+    {
+      struct heap_elem *next = pairs->next;
+
+      pairs->next = NULL;
+      root = root != NULL ? meld (heap, root, pairs) : pairs;
+      pairs = next;
+    }
+  return root;
+}
+
+/* Adds ELEM to HEAP, keeping its sequence number.  Does not
+   update HEAP's size. */
+static void
+insert (struct heap *heap, struct heap_elem *elem)
+{
+  elem->child = elem->next = elem->prev = NULL;
+  heap->root = heap->root != NULL ? meld (heap, heap->root, elem) : elem;
+}
+
+/* Removes ELEM from HEAP, putting its children in its place.
+   Does not update HEAP's size. */
+static void
+detach (struct heap *heap, struct heap_elem *elem)
+{
+  struct heap_elem *children;
+
+  if (elem == heap->root)
+    {
+      heap->root = merge_pairs (heap, elem->child);
+      return;
+    }
+
+  /* Unlink ELEM from its parent and siblings. */
+  if (elem->prev->child == elem)
+    elem->prev->child = elem->next;
+  else
+    elem->prev->next = elem->next;
+  if (elem->next != NULL)
+    elem->next->prev = elem->prev;
+
+  /* Put its children back in the tree. */
+  children = merge_pairs (heap, elem->child);
+  if (children != NULL)
+    heap->root = meld (heap, heap->root, children);
+}
@@ -0,0 +1,76 @@
+#ifndef __LIB_KERNEL_HEAP_H
+#define __LIB_KERNEL_HEAP_H
+
+/* Priority queue.
+
+   This is a pairing heap, a heap-ordered multiway tree that,
+   like our lists, does not require use of dynamically allocated
+   memory.  Each structure that is a potential heap element must
+   embed a struct heap_elem member, and the heap_entry macro
+   converts a struct heap_elem back to the structure that
+   contains it, just as list_entry does for lists.
+
+   A heap is ordered by a heap_less_func supplied to
+   heap_init().  heap_max() returns the greatest element in
+   constant time.  heap_push() also takes constant time, while
+   heap_pop_max(), heap_remove() and heap_update() take
+   logarithmic amortized time.  Elements that compare equal come
+   out in the order in which they were pushed, so a heap of
+   waiting threads ordered by priority is FIFO within each
+   priority.
+
+   If the value that an element is ordered by changes while it
+   is in a heap, heap_update() must be called to move it to its
+   new place.
+
+   See M. L. Fredman et al., "The Pairing Heap: A New Form of
+   Self-Adjusting Heap", Algorithmica 1 (1986). */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Heap element. */
+struct heap_elem
+  {
+    struct heap_elem *child;    /* Leftmost child. */
+    struct heap_elem *next;     /* Sibling to the right. */
+    struct heap_elem *prev;     /* Sibling to the left, or parent. */
+    unsigned seq;               /* Order of insertion, breaks ties. */
+  };
+
+/* Converts pointer to heap element HEAP_ELEM into a pointer to
+   the structure that HEAP_ELEM is embedded inside.  Supply the
+   name of the outer structure STRUCT and the member name MEMBER
+   of the heap element. */
+#define heap_entry(HEAP_ELEM, STRUCT, MEMBER)           \
+        ((STRUCT *) ((uint8_t *) &(HEAP_ELEM)->seq      \
+                     - offsetof (STRUCT, MEMBER.seq)))
+
+/* Compares the value of two heap elements A and B, given
+   auxiliary data AUX.  Returns true if A is less than B, or
+   false if A is greater than or equal to B. */
+typedef bool heap_less_func (const struct heap_elem *a,
+                             const struct heap_elem *b,
+                             void *aux);
+
+/* Heap. */
+struct heap
+  {
+    struct heap_elem *root;     /* Greatest element, or null. */
+    size_t size;                /* Number of elements. */
+    unsigned next_seq;          /* Next insertion sequence number. */
+    heap_less_func *less;       /* Comparison function. */
+    void *aux;                  /* Auxiliary data for `less'. */
+  };
+
+void heap_init (struct heap *, heap_less_func *, void *aux);
+void heap_push (struct heap *, struct heap_elem *);
+struct heap_elem *heap_max (struct heap *);
+struct heap_elem *heap_pop_max (struct heap *);
+void heap_remove (struct heap *, struct heap_elem *);
+void heap_update (struct heap *, struct heap_elem *);
+size_t heap_size (struct heap *);
+bool heap_empty (struct heap *);
+
+#endif /* lib/kernel/heap.h */
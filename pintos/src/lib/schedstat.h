@@ -0,0 +1,27 @@
+#ifndef __LIB_SCHEDSTAT_H
+#define __LIB_SCHEDSTAT_H
+
+#include <stdint.h>
+
+/* Number of buckets in a wakeup latency histogram.  Bucket 0
+   counts wakeups that ran within the same timer tick, bucket I
+   for 0 < I < SCHEDSTAT_LATENCY_BUCKETS - 1 those that waited
+   2**(I-1) to 2**I - 1 ticks, and the last bucket the rest. */
+#define SCHEDSTAT_LATENCY_BUCKETS 8
+
+/* Scheduling statistics of a thread, in timer ticks.  Shared
+   between the kernel and the schedstat system call. */
+struct schedstat
+  {
+    int64_t user_ticks;         /* Ticks run in user mode. */
+    int64_t kernel_ticks;       /* Ticks run in kernel mode. */
+    int64_t ready_ticks;        /* Total ticks spent ready to run. */
+    int64_t max_ready_ticks;    /* Longest single wait while ready. */
+    unsigned voluntary_switches;   /* Switches away while blocking. */
+    unsigned involuntary_switches; /* Switches away while still ready. */
+    unsigned deadline_misses;   /* Real-time jobs late for deadline. */
+    unsigned wakeup_latency[SCHEDSTAT_LATENCY_BUCKETS];
+                                /* Ticks from unblock to run. */
+  };
+
+#endif /* lib/schedstat.h */
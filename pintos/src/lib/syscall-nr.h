@@ -29,7 +29,22 @@ enum
     SYS_MKDIR,                  /* Create a directory. */
     SYS_READDIR,                /* Reads a directory entry. */
     SYS_ISDIR,                  /* Tests if a fd represents a directory. */
-    SYS_INUMBER                 /* Returns the inode number for a fd. */
+    SYS_INUMBER,                /* Returns the inode number for a fd. */
+
+    /* Scheduler extensions. */
+    SYS_NICE,                   /* Adjust the process's nice value. */
+    SYS_SCHEDSTAT,              /* Obtain a thread's scheduling statistics. */
+    SYS_CLOCK_GETTIME,          /* Read a clock with nanosecond resolution. */
+    SYS_SCHED_RT,               /* Enter or leave the real-time class. */
+    SYS_SCHED_YIELD,            /* Yield, ending a real-time job. */
+
+    /* User-space synchronization. */
+    SYS_FUTEX_WAIT,             /* Sleep while a futex holds a value. */
+    SYS_FUTEX_WAKE,             /* Wake threads sleeping on a futex. */
+
+    /* CPU groups. */
+    SYS_SCHED_GROUP,            /* Tighten own group's weight and cap. */
+    SYS_SCHED_SETGROUP          /* Move to an unused, stricter group. */
   };
 
 #endif /* lib/syscall-nr.h */
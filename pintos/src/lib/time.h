@@ -0,0 +1,18 @@
+#ifndef __LIB_TIME_H
+#define __LIB_TIME_H
+
+#include <stdint.h>
+
+/* Clocks for clock_gettime(), numbered as in POSIX. */
+#define CLOCK_REALTIME 0        /* Time since the Unix epoch. */
+#define CLOCK_MONOTONIC 1       /* Time since boot. */
+
+/* A time, as seconds plus nanoseconds.  Shared between the
+   kernel and the clock_gettime system call. */
+struct timespec
+  {
+    int64_t tv_sec;             /* Seconds. */
+    long tv_nsec;               /* Nanoseconds, 0...999,999,999. */
+  };
+
+#endif /* lib/time.h */
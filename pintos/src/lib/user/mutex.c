@@ -0,0 +1,127 @@
+#include <mutex.h>
+#include <limits.h>
+#include <syscall.h>
+
+/* Atomically replaces *P by NEW if it equals OLD.  Returns the
+   previous value of *P. */
+static inline int
+cmpxchg (int *p, int old, int new)
+{
+  int prev;
+  asm volatile ("lock cmpxchgl %2, %1"
+                : "=a" (prev), "+m" (*p)
+                : "r" (new), "0" (old)
+                : "memory");
+  return prev;
+}
+
+/* Atomically stores NEW in *P and returns the previous value. */
+static inline int
+xchg (int *p, int new)
+{
+  asm volatile ("xchgl %0, %1"
+                : "+r" (new), "+m" (*p)
+                :
+                : "memory");
+  return new;
+}
+
+/* Atomically adds DELTA to *P and returns the previous value. */
+static inline int
+xadd (int *p, int delta)
+{
+  asm volatile ("lock xaddl %0, %1"
+                : "+r" (delta), "+m" (*p)
+                :
+                : "memory");
+  return delta;
+}
+
+/* Initializes mutex M as unlocked. */
+void
+mutex_init (struct mutex *m)
+{
+  m->state = 0;
+}
+
+/* Acquires mutex M, sleeping in the kernel only if another
+   thread holds it. */
+void
+mutex_lock (struct mutex *m)
+{
+  int c = cmpxchg (&m->state, 0, 1);
+  if (c == 0)
+    return;
+
+  /* Mark the mutex contended and sleep until it is released.
+     Whoever takes it on this path leaves the state at 2, so
+     its unlock will wake the next waiter. */
+  if (c != 2)
+    c = xchg (&m->state, 2);
+  while (c != 0)
+    {
+      futex_wait (&m->state, 2);
+      c = xchg (&m->state, 2);
+    }
+}
+
+/* Acquires mutex M if it is free, without sleeping.  Returns
+   true if successful. */
+bool
+mutex_trylock (struct mutex *m)
+{
+  return cmpxchg (&m->state, 0, 1) == 0;
+}
+
+/* Releases mutex M, which the caller must hold, waking one
+   sleeper if there may be any. */
+void
+mutex_unlock (struct mutex *m)
+{
+  if (xadd (&m->state, -1) != 1)
+    {
+      m->state = 0;
+      futex_wake (&m->state, 1);
+    }
+}
+
+/* Initializes condition variable CV. */
+void
+condvar_init (struct condvar *cv)
+{
+  cv->seq = 0;
+}
+
+/* Atomically releases M and waits for CV to be signaled, then
+   reacquires M.  As with the kernel's condition variables,
+   wakeups may be spurious, so callers must recheck their
+   condition in a loop. */
+void
+condvar_wait (struct condvar *cv, struct mutex *m)
+{
+  int seq = cv->seq;
+
+  mutex_unlock (m);
+  futex_wait (&cv->seq, seq);
+
+  /* Other threads may be woken along with us, so reacquire as
+     if contended to make sure our unlock wakes them in turn. */
+  while (xchg (&m->state, 2) != 0)
+    futex_wait (&m->state, 2);
+}
+
+/* Wakes one thread waiting on CV. */
+void
+condvar_signal (struct condvar *cv)
+{
+  xadd (&cv->seq, 1);
+  futex_wake (&cv->seq, 1);
+}
+
+/* Wakes all threads waiting on CV. */
+void
+condvar_broadcast (struct condvar *cv)
+{
+  xadd (&cv->seq, 1);
+  futex_wake (&cv->seq, INT_MAX);
+}
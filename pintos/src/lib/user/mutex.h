@@ -0,0 +1,33 @@
+#ifndef __LIB_USER_MUTEX_H
+#define __LIB_USER_MUTEX_H
+
+#include <stdbool.h>
+
+/* A mutex built on futexes.  Acquiring or releasing an
+   uncontended mutex never enters the kernel.  STATE is 0 when
+   the mutex is free, 1 when it is held with no waiters, and 2
+   when it is held and threads may be sleeping on it. */
+struct mutex
+  {
+    int state;
+  };
+
+void mutex_init (struct mutex *);
+void mutex_lock (struct mutex *);
+bool mutex_trylock (struct mutex *);
+void mutex_unlock (struct mutex *);
+
+/* A condition variable built on futexes.  SEQ is bumped on
+   every signal, so a waiter that sampled it before releasing
+   its mutex cannot miss a wakeup. */
+struct condvar
+  {
+    int seq;
+  };
+
+void condvar_init (struct condvar *);
+void condvar_wait (struct condvar *, struct mutex *);
+void condvar_signal (struct condvar *);
+void condvar_broadcast (struct condvar *);
+
+#endif /* lib/user/mutex.h */
@@ -188,3 +188,57 @@ inumber (int fd)
 {
   return syscall1 (SYS_INUMBER, fd);
 }
+
+int
+nice (int increment)
+{
+  return syscall1 (SYS_NICE, increment);
+}
+
+bool
+schedstat (pid_t pid, struct schedstat *st)
+{
+  return syscall2 (SYS_SCHEDSTAT, pid, st);
+}
+
+bool
+clock_gettime (int clock, struct timespec *ts)
+{
+  return syscall2 (SYS_CLOCK_GETTIME, clock, ts);
+}
+
+bool
+sched_rt (int runtime, int period, int deadline)
+{
+  return syscall3 (SYS_SCHED_RT, runtime, period, deadline);
+}
+
+void
+sched_yield (void)
+{
+  syscall0 (SYS_SCHED_YIELD);
+}
+
+bool
+sched_group (int group, int weight, int cap)
+{
+  return syscall3 (SYS_SCHED_GROUP, group, weight, cap);
+}
+
+bool
+sched_setgroup (int group)
+{
+  return syscall1 (SYS_SCHED_SETGROUP, group);
+}
+
+int
+futex_wait (int *futex, int expected)
+{
+  return syscall2 (SYS_FUTEX_WAIT, futex, expected);
+}
+
+int
+futex_wake (int *futex, int n)
+{
+  return syscall2 (SYS_FUTEX_WAKE, futex, n);
+}
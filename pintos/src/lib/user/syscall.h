@@ -3,6 +3,8 @@
 
 #include <stdbool.h>
 #include <debug.h>
+#include <schedstat.h>
+#include <time.h>
 
 /* Process identifier. */
 typedef int pid_t;
@@ -46,4 +48,17 @@ bool readdir (int fd, char name[READDIR_MAX_LEN + 1]);
 bool isdir (int fd);
 int inumber (int fd);
 
+/* Scheduler extensions. */
+int nice (int increment);
+bool schedstat (pid_t, struct schedstat *);
+bool clock_gettime (int clock, struct timespec *);
+bool sched_rt (int runtime, int period, int deadline);
+void sched_yield (void);
+bool sched_group (int group, int weight, int cap);
+bool sched_setgroup (int group);
+
+/* User-space synchronization. */
+int futex_wait (int *futex, int expected);
+int futex_wake (int *futex, int n);
+
 #endif /* lib/user/syscall.h */
@@ -0,0 +1,132 @@
+/* Test program for lib/kernel/heap.c.
+
+   Checks the heap against a brute-force search over the same
+   elements, under random pushes, pops, updates and removals.
+
+   This is not a test we will run on your submitted projects.
+   It is here for completeness.
+*/
+
+#undef NDEBUG
+#include <debug.h>
+#include <heap.h>
+#include <random.h>
+#include <stdio.h>
+#include "threads/test.h"
+
+/* Number of elements, and number of random operations. */
+#define MAX_SIZE 64
+#define OP_CNT 100000
+
+/* A heap element. */
+struct value
+  {
+    struct heap_elem elem;      /* Heap element. */
+    int value;                  /* Item value. */
+    bool in_heap;               /* In the heap? */
+    unsigned order;             /* Order of heap_push() calls. */
+  };
+
+static bool value_less (const struct heap_elem *, const struct heap_elem *,
+                        void *);
+static struct value *brute_max (struct value[], size_t);
+
+/* Test the heap implementation. */
+void
+test (void)
+{
+  static struct value values[MAX_SIZE];
+  struct heap heap;
+  unsigned order = 0;
+  size_t size = 0;
+  int op;
+
+  heap_init (&heap, value_less, NULL);
+  for (op = 0; op < OP_CNT; op++)
+    {
+      struct value *v = &values[random_ulong () % MAX_SIZE];
+
+      switch (random_ulong () % 4)
+        {
+        case 0:
+          /* Push.  Small values make for many ties. */
+          if (!v->in_heap)
+            {
+              v->value = random_ulong () % 8;
+              v->in_heap = true;
+              v->order = order++;
+              heap_push (&heap, &v->elem);
+              size++;
+            }
+          break;
+
+        case 1:
+          /* Pop the maximum, which must be the earliest pushed of
+             the greatest values. */
+          if (size > 0)
+            {
+              struct value *max = brute_max (values, MAX_SIZE);
+              ASSERT (heap_entry (heap_max (&heap), struct value, elem)
+                      == max);
+              ASSERT (heap_pop_max (&heap) == &max->elem);
+              max->in_heap = false;
+              size--;
+            }
+          break;
+
+        case 2:
+          /* Change a value in place. */
+          if (v->in_heap)
+            {
+              v->value = random_ulong () % 8;
+              heap_update (&heap, &v->elem);
+            }
+          break;
+
+        case 3:
+          /* Remove an arbitrary element. */
+          if (v->in_heap)
+            {
+              heap_remove (&heap, &v->elem);
+              v->in_heap = false;
+              size--;
+            }
+          break;
+        }
+      ASSERT (heap_size (&heap) == size);
+      ASSERT (heap_empty (&heap) == (size == 0));
+    }
+
+  printf ("heap: PASS\n");
+}
+
+/* Returns true if value A is less than value B, false
+   otherwise. */
+static bool
+value_less (const struct heap_elem *a_, const struct heap_elem *b_,
+            void *aux UNUSED)
+{
+  const struct value *a = heap_entry (a_, struct value, elem);
+  const struct value *b = heap_entry (b_, struct value, elem);
+
+  return a->value < b->value;
+}
+
+/* Returns the element of the CNT in ARRAY that is in the heap
+   and should come out of it first. */
+static struct value *
+brute_max (struct value array[], size_t cnt)
+{
+  struct value *max = NULL;
+  size_t i;
+
+  for (i = 0; i < cnt; i++)
+    {
+      struct value *v = &array[i];
+      if (v->in_heap
+          && (max == NULL || v->value > max->value
+              || (v->value == max->value && v->order < max->order)))
+        max = v;
+    }
+  return max;
+}
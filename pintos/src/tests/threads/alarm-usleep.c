@@ -0,0 +1,58 @@
+/* Checks that timer_usleep() for less than a timer tick blocks
+   the caller, letting a lower-priority thread run meanwhile,
+   and that it neither returns early nor waits out the rest of
+   the tick when the CPU is otherwise idle. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+#define SLEEP_US 500
+
+static thread_func spinner;
+static volatile bool done;
+static volatile int spins;
+static struct semaphore spinner_done;
+
+void
+test_alarm_usleep (void)
+{
+  int64_t start, elapsed;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  /* Sleep with a lower-priority thread ready to run. */
+  sema_init (&spinner_done, 0);
+  thread_create ("spinner", PRI_DEFAULT - 1, spinner, NULL);
+  start = timer_nanoseconds ();
+  timer_usleep (SLEEP_US);
+  elapsed = timer_nanoseconds () - start;
+  done = true;
+  sema_down (&spinner_done);
+  if (elapsed < SLEEP_US * 1000)
+    fail ("busy usleep returned after %lld ns", elapsed);
+  if (spins == 0)
+    fail ("lower-priority thread did not run during usleep");
+  msg ("busy usleep blocked");
+
+  /* Sleep with the CPU otherwise idle. */
+  start = timer_nanoseconds ();
+  timer_usleep (SLEEP_US);
+  elapsed = timer_nanoseconds () - start;
+  if (elapsed < SLEEP_US * 1000)
+    fail ("idle usleep returned after %lld ns", elapsed);
+  if (elapsed >= 1000 * 1000 * 1000 / TIMER_FREQ)
+    fail ("idle usleep took %lld ns", elapsed);
+  msg ("idle usleep on time");
+}
+
+static void
+spinner (void *aux UNUSED)
+{
+  while (!done)
+    spins++;
+  sema_up (&spinner_done);
+}
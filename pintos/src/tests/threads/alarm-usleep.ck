@@ -0,0 +1,11 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(alarm-usleep) begin
+(alarm-usleep) busy usleep blocked
+(alarm-usleep) idle usleep on time
+(alarm-usleep) end
+EOF
+pass;
@@ -0,0 +1,77 @@
+/* Checks that the FPU and SSE registers are part of each
+   thread's context.  Two threads each keep a running sum in
+   %xmm0 and yield after every addition, so that each one's
+   additions are interleaved with the other's.  Neither should
+   see the other's values. */
+
+#include <stdio.h>
+#include <string.h>
+#include "tests/threads/tests.h"
+#include "threads/fpu.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+#define ITERATIONS 100
+
+struct sse_thread
+  {
+    float start[4] __attribute__ ((aligned (16)));
+    float step[4] __attribute__ ((aligned (16)));
+    float expected[4] __attribute__ ((aligned (16)));
+    float result[4] __attribute__ ((aligned (16)));
+  };
+
+static struct sse_thread threads[2] =
+  {
+    {{1, 2, 3, 4}, {1, 1, 1, 1}, {101, 102, 103, 104}, {0}},
+    {{1000, 2000, 3000, 4000}, {-2, -4, -6, -8},
+     {800, 1600, 2400, 3200}, {0}},
+  };
+
+static struct semaphore done;
+static thread_func sse_thread;
+
+void
+test_fpu_sse (void)
+{
+  int i;
+
+  if (!fpu_enabled ())
+    fail ("FPU not enabled");
+
+  sema_init (&done, 0);
+  for (i = 0; i < 2; i++)
+    {
+      char name[16];
+      snprintf (name, sizeof name, "sse %d", i);
+      thread_create (name, PRI_DEFAULT, sse_thread, &threads[i]);
+    }
+  for (i = 0; i < 2; i++)
+    sema_down (&done);
+
+  for (i = 0; i < 2; i++)
+    {
+      if (memcmp (threads[i].result, threads[i].expected,
+                  sizeof threads[i].result))
+        fail ("thread %d's %%xmm0 was corrupted", i);
+      msg ("Thread %d's sums are correct.", i);
+    }
+}
+
+static void
+sse_thread (void *t_)
+{
+  struct sse_thread *t = t_;
+  int i;
+
+  asm volatile ("movaps %0, %%xmm0" : : "m" (t->start));
+  asm volatile ("movaps %0, %%xmm1" : : "m" (t->step));
+  for (i = 0; i < ITERATIONS; i++)
+    {
+      asm volatile ("addps %xmm1, %xmm0");
+      thread_yield ();
+    }
+  asm volatile ("movaps %%xmm0, %0" : "=m" (t->result));
+  sema_up (&done);
+}
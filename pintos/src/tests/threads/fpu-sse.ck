@@ -0,0 +1,11 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(fpu-sse) begin
+(fpu-sse) Thread 0's sums are correct.
+(fpu-sse) Thread 1's sums are correct.
+(fpu-sse) end
+EOF
+pass;
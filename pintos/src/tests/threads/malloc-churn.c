@@ -0,0 +1,93 @@
+/* Checks malloc() and free() under churn.  Several threads each
+   allocate blocks of every size class, fill each with a pattern
+   of its own, yield so that the others run in between, and then
+   check the patterns and free the blocks in a different order.
+   A block handed out twice, from a magazine or from its
+   descriptor, shows up as a corrupted pattern. */
+
+#include <stdio.h>
+#include <string.h>
+#include "tests/threads/tests.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+#define THREAD_CNT 4
+#define ROUNDS 50
+#define BLOCK_CNT 40
+
+static struct semaphore done;
+static int errors;
+static thread_func churn_thread;
+
+void
+test_malloc_churn (void)
+{
+  int i;
+
+  sema_init (&done, 0);
+  for (i = 0; i < THREAD_CNT; i++)
+    {
+      char name[16];
+
+      snprintf (name, sizeof name, "churn %d", i);
+      thread_create (name, PRI_DEFAULT, churn_thread, (void *) i);
+    }
+  for (i = 0; i < THREAD_CNT; i++)
+    sema_down (&done);
+
+  if (errors != 0)
+    fail ("%d blocks corrupted", errors);
+  msg ("all blocks intact");
+}
+
+/* Returns the size of the I'th block allocated in each round,
+   cycling through sizes from 1 to 1,500 bytes. */
+static size_t
+block_size (int i)
+{
+  return 1 + (size_t) i * 1499 / (BLOCK_CNT - 1);
+}
+
+/* Allocates, checks and frees blocks for ROUNDS rounds, filling
+   each block with a byte that depends on ID_, the round and the
+   block. */
+static void
+churn_thread (void *id_)
+{
+  int id = (int) id_;
+  unsigned char *blocks[BLOCK_CNT];
+  int round, i, j;
+
+  for (round = 0; round < ROUNDS; round++)
+    {
+      for (i = 0; i < BLOCK_CNT; i++)
+        {
+          blocks[i] = malloc (block_size (i));
+          if (blocks[i] == NULL)
+            fail ("malloc failed");
+          memset (blocks[i], id * 64 + round + i, block_size (i));
+          if (i % 8 == 0)
+            thread_yield ();
+        }
+
+      /* Check and free the odd blocks, then the even ones. */
+      for (j = 1; j >= 0; j--)
+        for (i = j; i < BLOCK_CNT; i += 2)
+          {
+            unsigned char byte = id * 64 + round + i;
+            size_t k;
+
+            for (k = 0; k < block_size (i); k++)
+              if (blocks[i][k] != byte)
+                {
+                  errors++;
+                  break;
+                }
+            free (blocks[i]);
+            if (i % 8 == 1)
+              thread_yield ();
+          }
+    }
+  sema_up (&done);
+}
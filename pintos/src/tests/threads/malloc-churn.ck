@@ -0,0 +1,10 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(malloc-churn) begin
+(malloc-churn) all blocks intact
+(malloc-churn) end
+EOF
+pass;
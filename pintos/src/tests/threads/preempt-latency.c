@@ -0,0 +1,101 @@
+/* Checks kernel preemption.  A low-priority thread spins for
+   SPIN_TICKS ticks with preemption disabled while a
+   high-priority thread wakes from a sleep partway through.  If
+   the spinning loop briefly enables preemption at each step, the
+   high-priority thread should run within a tick of waking up.
+   Otherwise it should have to wait until preemption is enabled
+   again, even if the loop calls cond_resched(), which does
+   nothing with preemption disabled. */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/interrupt.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+#define SLEEP_TICKS 3
+#define SPIN_TICKS 20
+
+/* What the spinner does at each step. */
+enum spin_step
+  {
+    SPIN_PLAIN,                 /* Nothing. */
+    SPIN_RESCHED,               /* Call cond_resched(). */
+    SPIN_WINDOW                 /* Enable and disable preemption. */
+  };
+
+static struct semaphore done;
+static int64_t latency;
+static thread_func sleeper, spinner;
+
+/* Runs the sleeper and the spinner, with the spinner doing STEP
+   at each step, and returns the sleeper's latency in ticks. */
+static int64_t
+run (enum spin_step step)
+{
+  sema_init (&done, 0);
+  thread_create ("sleeper", PRI_MAX, sleeper, NULL);
+  thread_create ("spinner", PRI_DEFAULT, spinner, &step);
+  sema_down (&done);
+  sema_down (&done);
+  return latency;
+}
+
+void
+test_preempt_latency (void)
+{
+  int64_t window, resched, plain;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  window = run (SPIN_WINDOW);
+  if (window > 1)
+    fail ("woke %"PRId64" ticks late with a preemption window", window);
+  msg ("latency with a preemption window is bounded");
+
+  resched = run (SPIN_RESCHED);
+  if (resched < SPIN_TICKS - SLEEP_TICKS - 1)
+    fail ("woke %"PRId64" ticks late with cond_resched()", resched);
+  msg ("cond_resched() does not preempt while disabled");
+
+  plain = run (SPIN_PLAIN);
+  if (plain < SPIN_TICKS - SLEEP_TICKS - 1)
+    fail ("woke %"PRId64" ticks late with preemption disabled", plain);
+  msg ("preemption is deferred while disabled");
+}
+
+/* Sleeps for SLEEP_TICKS ticks and records how late it got to
+   run. */
+static void
+sleeper (void *aux UNUSED)
+{
+  int64_t wakeup = timer_ticks () + SLEEP_TICKS;
+
+  timer_sleep (SLEEP_TICKS);
+  latency = timer_ticks () - wakeup;
+  sema_up (&done);
+}
+
+/* Spins for SPIN_TICKS ticks with preemption disabled, doing
+   *STEP_ at each step. */
+static void
+spinner (void *step_)
+{
+  enum spin_step step = *(enum spin_step *) step_;
+  int64_t start = timer_ticks ();
+
+  preempt_disable ();
+  while (timer_elapsed (start) < SPIN_TICKS)
+    if (step == SPIN_RESCHED)
+      cond_resched ();
+    else if (step == SPIN_WINDOW)
+      {
+        preempt_enable ();
+        preempt_disable ();
+      }
+  preempt_enable ();
+  sema_up (&done);
+}
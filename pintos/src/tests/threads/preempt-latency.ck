@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(preempt-latency) begin
+(preempt-latency) latency with a preemption window is bounded
+(preempt-latency) cond_resched() does not preempt while disabled
+(preempt-latency) preemption is deferred while disabled
+(preempt-latency) end
+EOF
+pass;
@@ -0,0 +1,167 @@
+/* Checks the real-time class.  Two real-time threads with a
+   combined density of about 0.57 run periodic jobs while four
+   CPU-bound threads at PRI_MAX compete for the CPU, and no job
+   should miss its deadline.  A real-time thread whose jobs need
+   more CPU than its budget should miss deadlines.  Finally,
+   admission control should refuse real-time threads beyond the
+   density limit. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/interrupt.h"
+#include "threads/smp.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+#define JOBS 10
+#define LOAD_CNT 4
+#define PROBE_MAX 16
+
+struct rt_thread
+  {
+    const char *name;
+    int runtime, period, deadline;  /* RT parameters, in ticks. */
+    int work;                       /* Ticks of CPU each job needs. */
+    int jobs;                       /* Number of jobs to run. */
+    bool admitted;                  /* Entered the class? */
+    struct schedstat st;            /* Statistics at exit. */
+  };
+
+static struct semaphore done;
+static volatile bool stop_load;
+static thread_func rt_thread, load_thread, probe_thread;
+
+static struct semaphore probed, probe_release;
+static bool probe_admitted;
+
+/* Runs each of the CNT threads in RTS to completion, with
+   LOAD_CNT CPU-bound threads running alongside. */
+static void
+run (struct rt_thread *rts, int cnt)
+{
+  int i;
+
+  /* The real-time threads must be created first, at PRI_MAX,
+     so that they get to run and enter the class. */
+  sema_init (&done, 0);
+  stop_load = false;
+  for (i = 0; i < cnt; i++)
+    thread_create (rts[i].name, PRI_MAX, rt_thread, &rts[i]);
+  for (i = 0; i < LOAD_CNT; i++)
+    thread_create ("load", PRI_MAX, load_thread, NULL);
+  for (i = 0; i < cnt; i++)
+    sema_down (&done);
+  stop_load = true;
+  for (i = 0; i < LOAD_CNT; i++)
+    sema_down (&done);
+}
+
+void
+test_rt_edf (void)
+{
+  struct rt_thread fit[2] =
+    {
+      {"rt-a", 3, 10, 10, 2, JOBS, false, {0}},
+      {"rt-b", 4, 20, 15, 3, JOBS, false, {0}},
+    };
+  struct rt_thread overrun[1] =
+    {
+      {"rt-over", 1, 5, 5, 3, JOBS / 2, false, {0}},
+    };
+  int admitted, expected;
+  int i;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  thread_set_priority (PRI_MAX);
+
+  run (fit, 2);
+  for (i = 0; i < 2; i++)
+    {
+      if (!fit[i].admitted)
+        fail ("%s not admitted", fit[i].name);
+      if (fit[i].st.deadline_misses != 0)
+        fail ("%s missed %u deadlines under load", fit[i].name,
+              fit[i].st.deadline_misses);
+    }
+  msg ("no deadline misses under load");
+
+  run (overrun, 1);
+  if (!overrun[0].admitted)
+    fail ("%s not admitted", overrun[0].name);
+  if (overrun[0].st.deadline_misses == 0)
+    fail ("%s missed no deadlines", overrun[0].name);
+  msg ("overrunning thread missed deadlines");
+
+  /* Each probe asks for density 0.5. */
+  sema_init (&probed, 0);
+  sema_init (&probe_release, 0);
+  for (admitted = 0; admitted < PROBE_MAX; admitted++)
+    {
+      thread_create ("probe", PRI_DEFAULT, probe_thread, NULL);
+      sema_down (&probed);
+      if (!probe_admitted)
+        break;
+    }
+  for (i = 0; i < admitted; i++)
+    {
+      sema_up (&probe_release);
+      sema_down (&probed);
+    }
+  expected = 19 * cpu_cnt / 10;
+  if (admitted != expected)
+    fail ("admitted %d threads at density 0.5, expected %d",
+          admitted, expected);
+  if (thread_set_rt (2, 1, 1) || thread_set_rt (1, 2, 4))
+    fail ("invalid parameters accepted");
+  msg ("admission control works");
+}
+
+/* Enters the real-time class with the parameters in RT_, runs
+   its jobs, and records its statistics. */
+static void
+rt_thread (void *rt_)
+{
+  struct rt_thread *rt = rt_;
+  int i;
+
+  rt->admitted = thread_set_rt (rt->runtime, rt->period, rt->deadline);
+  for (i = 0; i < rt->jobs; i++)
+    {
+      struct thread *cur = thread_current ();
+      int64_t start = cur->schedstat.kernel_ticks;
+
+      while (cur->schedstat.kernel_ticks < start + rt->work)
+        barrier ();
+      thread_rt_yield ();
+    }
+  thread_get_schedstat (thread_tid (), &rt->st);
+  thread_set_rt (0, 0, 0);
+  sema_up (&done);
+}
+
+/* Spins until told to stop. */
+static void
+load_thread (void *aux UNUSED)
+{
+  while (!stop_load)
+    barrier ();
+  sema_up (&done);
+}
+
+/* Tries to enter the real-time class with density 0.5 and
+   reports whether it could, then waits to be released. */
+static void
+probe_thread (void *aux UNUSED)
+{
+  probe_admitted = thread_set_rt (1, 2, 2);
+  sema_up (&probed);
+  if (probe_admitted)
+    {
+      sema_down (&probe_release);
+      thread_set_rt (0, 0, 0);
+      sema_up (&probed);
+    }
+}
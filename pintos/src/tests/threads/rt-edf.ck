@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(rt-edf) begin
+(rt-edf) no deadline misses under load
+(rt-edf) overrunning thread missed deadlines
+(rt-edf) admission control works
+(rt-edf) end
+EOF
+pass;
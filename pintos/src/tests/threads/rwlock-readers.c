@@ -0,0 +1,91 @@
+/* Checks that a readers-writer lock admits several readers at
+   once, and that a waiting writer keeps a newly arriving reader
+   of the same priority from joining them.
+
+   The main thread and five reader threads hold the lock for
+   reading together.  A writer then has to wait for all of them,
+   and a reader that arrives after the writer has to wait for
+   the writer. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+#define READER_CNT 5
+
+static thread_func reader_thread;
+static thread_func writer_thread;
+static thread_func late_reader_thread;
+
+static struct rwlock rwlock;
+static struct semaphore go;
+static int readers_inside;
+
+void
+test_rwlock_readers (void)
+{
+  int i;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  /* Make sure our priority is the default. */
+  ASSERT (thread_get_priority () == PRI_DEFAULT);
+
+  rwlock_init (&rwlock);
+  sema_init (&go, 0);
+
+  rwlock_acquire_read (&rwlock);
+  for (i = 0; i < READER_CNT; i++)
+    {
+      char name[16];
+      snprintf (name, sizeof name, "reader %d", i);
+      thread_create (name, PRI_DEFAULT + 1, reader_thread, NULL);
+    }
+  msg ("%d readers inside with the main thread.", readers_inside);
+  if (readers_inside != READER_CNT)
+    fail ("readers should not wait for each other");
+
+  thread_create ("writer", PRI_DEFAULT + 1, writer_thread, NULL);
+  msg ("Writer is waiting.");
+  thread_create ("late reader", PRI_DEFAULT + 1, late_reader_thread, NULL);
+  msg ("Late reader is waiting.");
+
+  rwlock_release_read (&rwlock);
+  msg ("Main thread released its read lock.");
+  for (i = 0; i < READER_CNT; i++)
+    sema_up (&go);
+  msg ("Main thread finished.");
+}
+
+static void
+reader_thread (void *aux UNUSED)
+{
+  rwlock_acquire_read (&rwlock);
+  readers_inside++;
+  msg ("Thread %s acquired the lock for reading.", thread_name ());
+  sema_down (&go);
+  readers_inside--;
+  msg ("Thread %s releasing the lock.", thread_name ());
+  rwlock_release_read (&rwlock);
+}
+
+static void
+writer_thread (void *aux UNUSED)
+{
+  rwlock_acquire_write (&rwlock);
+  msg ("Writer acquired the lock with %d readers inside.",
+       readers_inside);
+  rwlock_release_write (&rwlock);
+  msg ("Writer released the lock.");
+}
+
+static void
+late_reader_thread (void *aux UNUSED)
+{
+  rwlock_acquire_read (&rwlock);
+  msg ("Late reader acquired the lock for reading.");
+  rwlock_release_read (&rwlock);
+}
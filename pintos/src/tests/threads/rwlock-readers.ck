@@ -0,0 +1,27 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(rwlock-readers) begin
+(rwlock-readers) Thread reader 0 acquired the lock for reading.
+(rwlock-readers) Thread reader 1 acquired the lock for reading.
+(rwlock-readers) Thread reader 2 acquired the lock for reading.
+(rwlock-readers) Thread reader 3 acquired the lock for reading.
+(rwlock-readers) Thread reader 4 acquired the lock for reading.
+(rwlock-readers) 5 readers inside with the main thread.
+(rwlock-readers) Writer is waiting.
+(rwlock-readers) Late reader is waiting.
+(rwlock-readers) Main thread released its read lock.
+(rwlock-readers) Thread reader 0 releasing the lock.
+(rwlock-readers) Thread reader 1 releasing the lock.
+(rwlock-readers) Thread reader 2 releasing the lock.
+(rwlock-readers) Thread reader 3 releasing the lock.
+(rwlock-readers) Thread reader 4 releasing the lock.
+(rwlock-readers) Writer acquired the lock with 0 readers inside.
+(rwlock-readers) Writer released the lock.
+(rwlock-readers) Late reader acquired the lock for reading.
+(rwlock-readers) Main thread finished.
+(rwlock-readers) end
+EOF
+pass;
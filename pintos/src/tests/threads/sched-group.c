@@ -0,0 +1,159 @@
+/* Checks CPU groups.  Two CPU-bound threads, in groups with
+   weights 1024 and 3072, should split the CPU about 1:3.  A
+   CPU-bound thread in a group capped at 25% of a CPU should get
+   about a quarter of the ticks that pass, even with the CPU
+   otherwise idle.  A group that another thread is in cannot be
+   joined through thread_restrict_group(), and
+   thread_group_tighten() only tightens the caller's own group.
+   Like the priority tests, this assumes a single CPU. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/interrupt.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+#define RUN_TICKS 200
+
+struct spinner
+  {
+    int group;                  /* Group to run in. */
+    long long ticks;            /* Ticks it got. */
+  };
+
+static struct semaphore done;
+static volatile bool stop;
+static thread_func spinner;
+static thread_func holder;
+static void check_restrict (void);
+
+/* Runs the CNT threads in SPINNERS for RUN_TICKS ticks. */
+static void
+run (struct spinner *spinners, int cnt)
+{
+  int i;
+
+  sema_init (&done, 0);
+  stop = false;
+  for (i = 0; i < cnt; i++)
+    thread_create ("spinner", PRI_DEFAULT, spinner, &spinners[i]);
+  timer_sleep (RUN_TICKS);
+  stop = true;
+  for (i = 0; i < cnt; i++)
+    sema_down (&done);
+}
+
+void
+test_sched_group (void)
+{
+  struct spinner weighted[2] = {{1, 0}, {2, 0}};
+  struct spinner capped[1] = {{3, 0}};
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  thread_set_priority (PRI_MAX);
+
+  if (!thread_group_config (1, 1024, 0)
+      || !thread_group_config (2, 3072, 0)
+      || !thread_group_config (3, GROUP_WEIGHT_DEFAULT, 25))
+    fail ("valid group configuration rejected");
+
+  run (weighted, 2);
+  if (weighted[0].ticks == 0
+      || weighted[1].ticks < 2 * weighted[0].ticks
+      || weighted[1].ticks > 4 * weighted[0].ticks)
+    fail ("weights 1024 and 3072 got %lld and %lld ticks",
+          weighted[0].ticks, weighted[1].ticks);
+  msg ("weights are honored");
+
+  run (capped, 1);
+  if (capped[0].ticks < RUN_TICKS / 4 - RUN_TICKS / 10
+      || capped[0].ticks > RUN_TICKS / 4 + RUN_TICKS / 10)
+    fail ("group capped at 25%% got %lld of %d ticks",
+          capped[0].ticks, RUN_TICKS);
+  msg ("cap is honored");
+
+  if (thread_group_config (0, GROUP_WEIGHT_DEFAULT, 50)
+      || thread_group_config (GROUP_CNT, GROUP_WEIGHT_DEFAULT, 0)
+      || thread_group_config (1, 0, 0)
+      || thread_group_config (1, GROUP_WEIGHT_DEFAULT, -1)
+      || thread_set_group (GROUP_CNT))
+    fail ("invalid group configuration accepted");
+  msg ("invalid configuration rejected");
+
+  check_restrict ();
+
+  thread_group_config (3, GROUP_WEIGHT_DEFAULT, 0);
+}
+
+/* Checks that the running thread cannot join group 4 while a
+   holder thread is in it, but may join the equally restricted
+   group 5, and then only tighten group 5. */
+static void
+check_restrict (void)
+{
+  struct semaphore release;
+  int half = GROUP_WEIGHT_DEFAULT / 2;
+
+  thread_group_config (4, half, 50);
+  thread_group_config (5, half, 50);
+
+  /* The holder starts out in its creator's group. */
+  sema_init (&done, 0);
+  sema_init (&release, 0);
+  thread_set_group (4);
+  thread_create ("holder", PRI_DEFAULT, holder, &release);
+  thread_set_group (0);
+
+  if (thread_restrict_group (4))
+    fail ("joined group 4 while another thread is in it");
+  if (!thread_restrict_group (5) || thread_get_group () != 5)
+    fail ("could not join unused group 5");
+  if (thread_restrict_group (0))
+    fail ("moved back to less restrictive group 0");
+  msg ("only unused, stricter groups can be joined");
+
+  if (thread_group_tighten (5, GROUP_WEIGHT_DEFAULT, 50)
+      || thread_group_tighten (5, half, 0)
+      || thread_group_tighten (5, half, 75)
+      || thread_group_tighten (4, half / 2, 25))
+    fail ("group limits loosened, or another group changed");
+  if (!thread_group_tighten (5, half / 2, 25))
+    fail ("could not tighten own group");
+  msg ("own group can only be tightened");
+
+  thread_set_group (0);
+  sema_up (&release);
+  sema_down (&done);
+  thread_group_config (4, GROUP_WEIGHT_DEFAULT, 0);
+  thread_group_config (5, GROUP_WEIGHT_DEFAULT, 0);
+}
+
+/* Stays in its group until RELEASE_ is upped. */
+static void
+holder (void *release_)
+{
+  struct semaphore *release = release_;
+
+  sema_down (release);
+  sema_up (&done);
+}
+
+/* Moves to the group in SPINNER_ and spins until told to stop,
+   then records how many ticks it ran. */
+static void
+spinner (void *spinner_)
+{
+  struct spinner *s = spinner_;
+  struct thread *cur = thread_current ();
+  long long start;
+
+  thread_set_group (s->group);
+  start = cur->schedstat.kernel_ticks;
+  while (!stop)
+    barrier ();
+  s->ticks = cur->schedstat.kernel_ticks - start;
+  sema_up (&done);
+}
@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(sched-group) begin
+(sched-group) weights are honored
+(sched-group) cap is honored
+(sched-group) invalid configuration rejected
+(sched-group) only unused, stricter groups can be joined
+(sched-group) own group can only be tightened
+(sched-group) end
+EOF
+pass;
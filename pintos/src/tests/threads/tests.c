@@ -16,6 +16,7 @@ static const struct test tests[] =
     {"alarm-simultaneous", test_alarm_simultaneous},
     {"alarm-priority", test_alarm_priority},
     {"alarm-zero", test_alarm_zero},
+    {"alarm-usleep", test_alarm_usleep},
     {"alarm-negative", test_alarm_negative},
     {"priority-change", test_priority_change},
     {"priority-donate-one", test_priority_donate_one},
@@ -29,6 +30,12 @@ static const struct test tests[] =
     {"priority-preempt", test_priority_preempt},
     {"priority-sema", test_priority_sema},
     {"priority-condvar", test_priority_condvar},
+    {"rwlock-readers", test_rwlock_readers},
+    {"fpu-sse", test_fpu_sse},
+    {"rt-edf", test_rt_edf},
+    {"sched-group", test_sched_group},
+    {"preempt-latency", test_preempt_latency},
+    {"malloc-churn", test_malloc_churn},
     {"mlfqs-load-1", test_mlfqs_load_1},
     {"mlfqs-load-60", test_mlfqs_load_60},
     {"mlfqs-load-avg", test_mlfqs_load_avg},
@@ -0,0 +1,256 @@
+#include "threads/fpu.h"
+#include <debug.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/interrupt.h"
+#include "threads/malloc.h"
+#include "threads/smp.h"
+#include "threads/thread.h"
+#ifdef USERPROG
+#include "userprog/gdt.h"
+#endif
+
+/* Floating-point and SIMD context switching.
+
+   The x87 FPU, MMX and SSE registers are saved and restored as
+   a unit with FXSAVE and FXRSTOR, into a 512-byte area that a
+   thread gets the first time it uses any of them.  Most threads
+   never do, so switching to a thread does not restore its FPU
+   state.  Instead, it sets CR0.TS, which makes the thread's
+   first FPU instruction raise a #NM (Device Not Available)
+   exception, whose handler restores the state and clears TS.
+
+   Each CPU remembers whose state its registers hold, in `struct
+   cpu'.  A thread that used the FPU saves its state when it is
+   switched out, because it may be switched in next on a
+   different CPU, but if it then comes back to the same CPU
+   with no other thread's state loaded in between, it gets to
+   run with TS clear and needs no restore at all.
+
+   See [IA32-v1] 11.6 and [IA32-v3a] 13.4. */
+
+/* Flags in control registers. */
+#define CR0_MP 0x00000002       /* Monitor Coprocessor. */
+#define CR0_EM 0x00000004       /* (Floating-point) Emulation. */
+#define CR0_TS 0x00000008       /* Task Switched. */
+#define CR0_NE 0x00000020       /* Numeric Error. */
+#define CR4_OSFXSR 0x00000200   /* OS supports FXSAVE/FXRSTOR. */
+#define CR4_OSXMMEXCPT 0x00000400 /* OS supports SIMD exceptions. */
+
+/* CPUID.1:EDX feature flags. */
+#define CPUID_FXSR (1u << 24)   /* FXSAVE and FXRSTOR. */
+#define CPUID_SSE (1u << 25)    /* SSE. */
+
+/* Size and alignment of an FXSAVE area. */
+#define FPU_STATE_SIZE 512
+#define FPU_STATE_ALIGN 16
+
+/* True if the FPU is usable, false if FPU instructions still
+   trap as they did before fpu_init(). */
+static bool enabled;
+
+/* Freshly initialized FPU state, copied to each thread's state
+   area when it is allocated. */
+static uint8_t initial_state[FPU_STATE_SIZE]
+  __attribute__ ((aligned (FPU_STATE_ALIGN)));
+
+static intr_handler_func fpu_trap;
+static bool init_cpu (void);
+
+static inline uint32_t
+read_cr0 (void)
+{
+  uint32_t cr0;
+  asm volatile ("movl %%cr0, %0" : "=r" (cr0));
+  return cr0;
+}
+
+static inline void
+write_cr0 (uint32_t cr0)
+{
+  asm volatile ("movl %0, %%cr0" : : "r" (cr0) : "memory");
+}
+
+static inline void
+fxsave (void *state)
+{
+  asm volatile ("fxsave %0" : "=m" (*(uint8_t (*)[FPU_STATE_SIZE]) state));
+}
+
+static inline void
+fxrstor (const void *state)
+{
+  asm volatile ("fxrstor %0"
+                : : "m" (*(const uint8_t (*)[FPU_STATE_SIZE]) state));
+}
+
+/* Enables the FPU on the bootstrap processor, if it supports
+   FXSAVE and SSE, and registers the #NM handler.  If it does
+   not, FPU instructions go on trapping and a user process that
+   executes one is killed. */
+void
+fpu_init (void)
+{
+  intr_register_int (7, 0, INTR_OFF, fpu_trap,
+                     "#NM Device Not Available Exception");
+  enabled = init_cpu ();
+  if (enabled)
+    {
+      fxsave (initial_state);
+      write_cr0 (read_cr0 () | CR0_TS);
+    }
+  else
+    printf ("fpu: no FXSAVE or SSE support, FPU disabled\n");
+}
+
+/* Enables the FPU on the application processor that calls this
+   function, like fpu_init() did on the bootstrap processor. */
+void
+fpu_init_ap (void)
+{
+  if (enabled && init_cpu ())
+    write_cr0 (read_cr0 () | CR0_TS);
+}
+
+/* Returns true if threads may use the FPU. */
+bool
+fpu_enabled (void)
+{
+  return enabled;
+}
+
+/* If the running CPU supports FXSAVE and SSE, stops FPU
+   instructions from trapping, resets the FPU and returns true.
+   Otherwise, returns false. */
+static bool
+init_cpu (void)
+{
+  uint32_t eax = 1, ebx, ecx, edx;
+  uint32_t cr4;
+
+  asm ("cpuid" : "+a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx));
+  if ((edx & (CPUID_FXSR | CPUID_SSE)) != (CPUID_FXSR | CPUID_SSE))
+    return false;
+
+  asm volatile ("movl %%cr4, %0" : "=r" (cr4));
+  cr4 |= CR4_OSFXSR | CR4_OSXMMEXCPT;
+  asm volatile ("movl %0, %%cr4" : : "r" (cr4));
+  write_cr0 ((read_cr0 () & ~(CR0_EM | CR0_TS)) | CR0_MP | CR0_NE);
+  asm volatile ("fninit");
+  return true;
+}
+
+/* Called by schedule() with interrupts off when CUR, the
+   running thread, is about to switch to NEXT.  Saves CUR's FPU
+   state if it has used the FPU since it was switched in, then
+   sets CR0.TS unless NEXT's state is the one in the FPU
+   registers. */
+void
+fpu_switch (struct thread *cur, struct thread *next)
+{
+  struct cpu *cpu = cur->cpu;
+  uint32_t cr0;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (!enabled)
+    return;
+
+  /* TS is clear only after the #NM handler loaded CUR's state. */
+  cr0 = read_cr0 ();
+  if (!(cr0 & CR0_TS))
+    {
+      ASSERT (cpu->fpu_owner == cur);
+      fxsave (cur->fpu_state);
+    }
+
+  if (cpu->fpu_owner == next && next->fpu_cpu == cpu)
+    {
+      if (cr0 & CR0_TS)
+        asm volatile ("clts");
+    }
+  else if (!(cr0 & CR0_TS))
+    write_cr0 (cr0 | CR0_TS);
+}
+
+/* Releases the FPU state of T, the running thread, which is
+   about to exit. */
+void
+fpu_thread_exit (struct thread *t)
+{
+  enum intr_level old_level;
+  void *block;
+  int i;
+
+  ASSERT (t == thread_current ());
+
+  /* The next thread to use T's page must not find itself the
+     owner of T's registers. */
+  old_level = intr_disable ();
+  for (i = 0; i < cpu_cnt; i++)
+    if (cpus[i].fpu_owner == t)
+      cpus[i].fpu_owner = NULL;
+  if (enabled)
+    write_cr0 (read_cr0 () | CR0_TS);
+  block = t->fpu_block;
+  t->fpu_block = t->fpu_state = NULL;
+  t->fpu_cpu = NULL;
+  intr_set_level (old_level);
+
+  free (block);
+}
+
+/* Kills the running thread, or panics if it is a kernel thread,
+   because it cannot use the FPU.  Prints WHY as the reason. */
+static void
+fpu_fail (struct intr_frame *f, const char *why)
+{
+#ifdef USERPROG
+  if (f->cs == SEL_UCSEG)
+    {
+      printf ("%s: dying due to interrupt %#04x (%s): %s.\n",
+              thread_name (), f->vec_no, intr_name (f->vec_no), why);
+      thread_exit ();
+    }
+#endif
+  intr_dump_frame (f);
+  PANIC ("FPU used in kernel: %s", why);
+}
+
+/* #NM handler, entered when the running thread uses the FPU
+   with CR0.TS set (or with CR0.EM set, if the FPU is disabled).
+   Gives the thread an FPU state area if it lacks one, loads the
+   state into the FPU and clears TS, so that the faulting
+   instruction succeeds when it is restarted. */
+static void
+fpu_trap (struct intr_frame *f)
+{
+  struct thread *cur = thread_current ();
+  struct cpu *cpu;
+
+  if (!enabled)
+    fpu_fail (f, "no FPU support");
+
+  if (cur->fpu_state == NULL)
+    {
+      /* malloc() may sleep, after which we may be running on a
+         different CPU. */
+      uint8_t *block = malloc (FPU_STATE_SIZE + FPU_STATE_ALIGN - 1);
+      if (block == NULL)
+        fpu_fail (f, "out of memory for FPU state");
+      cur->fpu_block = block;
+      cur->fpu_state = (void *) (((uintptr_t) block + FPU_STATE_ALIGN - 1)
+                                 & ~(uintptr_t) (FPU_STATE_ALIGN - 1));
+      memcpy (cur->fpu_state, initial_state, FPU_STATE_SIZE);
+    }
+
+  cpu = cur->cpu;
+  asm volatile ("clts");
+  if (cpu->fpu_owner != cur || cur->fpu_cpu != cpu)
+    {
+      fxrstor (cur->fpu_state);
+      cpu->fpu_owner = cur;
+      cur->fpu_cpu = cpu;
+    }
+}
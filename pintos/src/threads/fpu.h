@@ -0,0 +1,14 @@
+#ifndef THREADS_FPU_H
+#define THREADS_FPU_H
+
+#include <stdbool.h>
+
+struct thread;
+
+void fpu_init (void);
+void fpu_init_ap (void);
+bool fpu_enabled (void);
+void fpu_switch (struct thread *cur, struct thread *next);
+void fpu_thread_exit (struct thread *);
+
+#endif /* threads/fpu.h */
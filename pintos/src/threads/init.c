@@ -15,12 +15,15 @@
 #include "devices/timer.h"
 #include "devices/vga.h"
 #include "devices/rtc.h"
+#include "threads/fpu.h"
 #include "threads/interrupt.h"
 #include "threads/io.h"
 #include "threads/loader.h"
+#include "threads/lockstat.h"
 #include "threads/malloc.h"
 #include "threads/palloc.h"
 #include "threads/pte.h"
+#include "threads/smp.h"
 #include "threads/thread.h"
 #ifdef USERPROG
 #include "userprog/process.h"
@@ -28,6 +31,11 @@
 #include "userprog/gdt.h"
 #include "userprog/syscall.h"
 #include "userprog/tss.h"
+#ifdef VM
+#include "vm/frame.h"
+#include "vm/page.h"
+#include "vm/swap.h"
+#endif
 #else
 #include "tests/threads/tests.h"
 #endif
@@ -57,11 +65,20 @@ static const char *swap_bdev_name;
 /* -ul: Maximum number of pages to put into palloc's user pool. */
 static size_t user_page_limit = SIZE_MAX;
 
+/* -nosmp: Run on the bootstrap processor only? */
+static bool no_smp;
+
+#ifdef USERPROG
+/* -rungroup: CPU group that "run" starts programs in. */
+static int run_group;
+#endif
+
 static void bss_init (void);
 static void paging_init (void);
 
 static char **read_command_line (void);
 static char **parse_options (char **argv);
+static void parse_group (char *value);
 static void run_actions (char **argv);
 static void usage (void);
 
@@ -107,12 +124,17 @@ main (void)
 
   /* Initialize interrupt handlers. */
   intr_init ();
+  fpu_init ();
   timer_init ();
   kbd_init ();
   input_init ();
 #ifdef USERPROG
   exception_init ();
   syscall_init ();
+#ifdef VM
+  page_init ();
+  frame_init ();
+#endif
 #endif
 
   /* Start thread scheduler and enable interrupts. */
@@ -120,12 +142,19 @@ main (void)
   serial_init_queue ();
   timer_calibrate ();
 
+  /* Start the other CPUs. */
+  if (!no_smp)
+    smp_init ();
+
 #ifdef FILESYS
   /* Initialize file system. */
   ide_init ();
   locate_block_devices ();
   filesys_init (format_filesys);
 #endif
+#ifdef VM
+  swap_init ();
+#endif
 
   printf ("Boot complete.\n");
 
@@ -256,9 +285,25 @@ parse_options (char **argv)
         random_init (atoi (value));
       else if (!strcmp (name, "-mlfqs"))
         thread_mlfqs = true;
+      else if (!strcmp (name, "-tickless"))
+        timer_tickless = true;
+      else if (!strcmp (name, "-nosmp"))
+        no_smp = true;
+      else if (!strcmp (name, "-zerostack"))
+        thread_zero_stacks = true;
+      else if (!strcmp (name, "-schedstat"))
+        thread_schedstat = true;
+      else if (!strcmp (name, "-lockstat"))
+        lockstat_enabled = true;
+      else if (!strcmp (name, "-irqsoff"))
+        irqsoff_enabled = true;
+      else if (!strcmp (name, "-group"))
+        parse_group (value);
 #ifdef USERPROG
       else if (!strcmp (name, "-ul"))
         user_page_limit = atoi (value);
+      else if (!strcmp (name, "-rungroup"))
+        run_group = atoi (value);
 #endif
       else
         PANIC ("unknown option `%s' (use -h for help)", name);
@@ -277,6 +322,25 @@ parse_options (char **argv)
   return argv;
 }
 
+/* Configures a CPU group as given by VALUE, the argument of
+   option "-group", in the form GROUP,WEIGHT[,CAP]. */
+static void
+parse_group (char *value)
+{
+  char *save_ptr;
+  char *group, *weight, *cap;
+
+  if (value == NULL)
+    PANIC ("-group requires an argument (use -h for help)");
+  group = strtok_r (value, ",", &save_ptr);
+  weight = strtok_r (NULL, ",", &save_ptr);
+  cap = strtok_r (NULL, "", &save_ptr);
+  if (group == NULL || weight == NULL
+      || !thread_group_config (atoi (group), atoi (weight),
+                               cap != NULL ? atoi (cap) : 0))
+    PANIC ("bad CPU group `%s' (use -h for help)", value);
+}
+
 /* Runs the task specified in ARGV[1]. */
 static void
 run_task (char **argv)
@@ -285,7 +349,10 @@ run_task (char **argv)
 
   printf ("Executing '%s':\n", task);
 #ifdef USERPROG
+  if (!thread_set_group (run_group))
+    PANIC ("bad CPU group %d for \"run\"", run_group);
   process_wait (process_execute (task));
+  thread_set_group (0);
 #else
   run_test (task);
 #endif
@@ -379,8 +446,17 @@ usage (void)
 #endif
           "  -rs=SEED           Set random number seed to SEED.\n"
           "  -mlfqs             Use multi-level feedback queue scheduler.\n"
+          "  -tickless          Stop the timer interrupt while idle.\n"
+          "  -nosmp             Use only the bootstrap processor.\n"
+          "  -zerostack         Zero-fill every new thread's stack.\n"
+          "  -schedstat         Print per-thread scheduling statistics.\n"
+          "  -lockstat          Profile lock contention.\n"
+          "  -irqsoff           Measure how long interrupts stay off.\n"
+          "  -group=G,W[,CAP]   Give CPU group G weight W (default 1024)\n"
+          "                     and cap it at CAP percent of a CPU.\n"
 #ifdef USERPROG
           "  -ul=COUNT          Limit user memory to COUNT pages.\n"
+          "  -rungroup=G        Run programs in CPU group G.\n"
 #endif
           );
   shutdown_power_off ();
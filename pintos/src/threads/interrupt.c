@@ -6,8 +6,11 @@
 #include "threads/flags.h"
 #include "threads/intr-stubs.h"
 #include "threads/io.h"
+#include "threads/smp.h"
+#include "threads/spinlock.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
+#include "devices/lapic.h"
 #include "devices/timer.h"
 
 /* Programmable Interrupt Controller (PIC) registers.
@@ -37,15 +40,66 @@ static const char *intr_names[INTR_CNT];
    unexpected interrupt is one that has no registered handler. */
 static unsigned int unexpected_cnt[INTR_CNT];
 
+/* Longest time, in CPU cycles, that an external interrupt
+   handler has run with interrupts off, and its vector. */
+static uint64_t longest_handler_cycles;
+static uint8_t longest_handler_vec;
+
+/* Interrupts-off tracer.
+
+   Each CPU notes the TSC and the caller whenever its interrupts
+   go from on to off, whether by intr_disable() or by entering an
+   interrupt gate, and measures the window when they come back
+   on, by intr_enable(), intr_enable_and_wait(), or returning
+   from the interrupt.  A window that is still open when its
+   thread switches away is closed by whichever thread next turns
+   interrupts on, since it is the CPU that cannot take
+   interrupts.
+
+   Windows are counted in a histogram with power-of-2 bounds in
+   microseconds.  Windows closed before timer_calibrate() has
+   measured the TSC are not counted.  Statistics are updated
+   with interrupts off, before the interrupt lock is
+   released. */
+bool irqsoff_enabled;
+
+#define IRQSOFF_BUCKETS 16      /* <1 us, <2 us, ..., >= 16.384 ms. */
+static unsigned long long irqsoff_hist[IRQSOFF_BUCKETS];
+static int64_t irqsoff_longest_ns;      /* Longest window... */
+static void *irqsoff_longest_caller;    /* ...where it began... */
+static int irqsoff_longest_cpu;         /* ...and on which CPU. */
+
+static void irqsoff_begin (void *caller);
+static void irqsoff_end (void);
+static enum intr_level disable (void *caller);
+
 /* External interrupts are those generated by devices outside the
    CPU, such as the timer.  External interrupts run with
    interrupts turned off, so they never nest, nor are they ever
    pre-empted.  Handlers for external interrupts also may not
    sleep, although they may invoke intr_yield_on_return() to
    request that a new process be scheduled just before the
-   interrupt returns. */
-static bool in_external_intr;   /* Are we processing an external interrupt? */
-static bool yield_on_return;    /* Should we yield on interrupt return? */
+   interrupt returns.  Each CPU tracks this for itself, in the
+   in_external_intr and yield_on_return members of its struct
+   cpu.
+
+   Besides the PIC's interrupts, those raised by a CPU's local
+   APIC (its timer and interprocessor interrupts, in vectors
+   0x40...0x4e) are also external interrupts. */
+
+/* Interrupt lock.
+
+   Pintos code protects shared data by turning interrupts off,
+   which only excludes other code on the same CPU.  Once more
+   than one CPU is running (smp_active), a CPU therefore also
+   holds this lock whenever its interrupts are off, so that
+   "interrupts off" still means "nobody else is running kernel
+   code that assumes exclusive access".  The lock belongs to the
+   CPU, not to a thread: a thread that switches to another with
+   interrupts off hands the lock over along with the CPU. */
+static struct spinlock intr_lock;
+
+static void intr_lock_acquire (void);
 
 /* Programmable Interrupt Controller helpers. */
 static void pic_init (void);
@@ -57,6 +111,8 @@ static uint64_t make_trap_gate (void (*) (void), int dpl);
 static inline uint64_t make_idtr_operand (uint16_t limit, void *base);
 
 /* Interrupt handlers. */
+static void load_idt (void);
+static bool is_external (uint8_t vec_no);
 void intr_handler (struct intr_frame *args);
 static void unexpected_interrupt (const struct intr_frame *);
 
@@ -80,7 +136,10 @@ intr_get_level (void)
 enum intr_level
 intr_set_level (enum intr_level level)
 {
-  return level == INTR_ON ? intr_enable () : intr_disable ();
+  if (level == INTR_ON)
+    return intr_enable ();
+  else
+    return disable (__builtin_return_address (0));
 }
 
 /* Enables interrupts and returns the previous interrupt status. */
@@ -90,6 +149,14 @@ intr_enable (void)
   enum intr_level old_level = intr_get_level ();
   ASSERT (!intr_context ());
 
+  if (old_level == INTR_OFF)
+    {
+      if (irqsoff_enabled)
+        irqsoff_end ();
+      if (smp_active)
+        spinlock_release (&intr_lock);
+    }
+
   /* Enable interrupts by setting the interrupt flag.
 
      See [IA32-v2b] "STI" and [IA32-v3a] 5.8.1 "Masking Maskable
@@ -102,6 +169,14 @@ intr_enable (void)
 /* Disables interrupts and returns the previous interrupt status. */
 enum intr_level
 intr_disable (void)
+{
+  return disable (__builtin_return_address (0));
+}
+
+/* Disables interrupts on behalf of CALLER and returns the
+   previous interrupt status. */
+static enum intr_level
+disable (void *caller)
 {
   enum intr_level old_level = intr_get_level ();
 
@@ -110,14 +185,102 @@ intr_disable (void)
      Hardware Interrupts". */
   asm volatile ("cli" : : : "memory");
 
+  if (old_level == INTR_ON)
+    {
+      if (irqsoff_enabled)
+        irqsoff_begin (caller);
+      if (smp_active)
+        intr_lock_acquire ();
+    }
+
   return old_level;
 }
 
+/* Enables interrupts and waits for the next one to arrive.
+   Interrupts must be off.
+
+   The `sti' instruction disables interrupts until the
+   completion of the next instruction, so these two instructions
+   are executed atomically.  This atomicity is important;
+   otherwise, an interrupt could be handled between re-enabling
+   interrupts and waiting for the next one to occur, wasting as
+   much as one clock tick worth of time.
+
+   See [IA32-v2a] "HLT", [IA32-v2b] "STI", and [IA32-v3a]
+   7.11.1 "HLT Instruction". */
+void
+intr_enable_and_wait (void)
+{
+  ASSERT (!intr_context ());
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (irqsoff_enabled)
+    irqsoff_end ();
+  if (smp_active)
+    spinlock_release (&intr_lock);
+  asm volatile ("sti; hlt" : : : "memory");
+}
+
+/* Opens an interrupts-off window on the running CPU, whose
+   interrupts were just turned off by CALLER. */
+static void
+irqsoff_begin (void *caller)
+{
+  struct cpu *cpu = cpu_current ();
+
+  cpu->irqsoff_start = rdtsc ();
+  cpu->irqsoff_caller = caller;
+}
+
+/* Closes the running CPU's interrupts-off window, if it has one
+   open, and records its length.  Interrupts must still be
+   off. */
+static void
+irqsoff_end (void)
+{
+  struct cpu *cpu = cpu_current ();
+  int64_t ns;
+  uint64_t us;
+  int bucket;
+
+  if (cpu->irqsoff_start == 0)
+    return;
+  ns = timer_cycles_to_ns (rdtsc () - cpu->irqsoff_start);
+  cpu->irqsoff_start = 0;
+  if (ns == 0)
+    return;
+
+  bucket = 0;
+  for (us = ns / 1000; us > 0 && bucket < IRQSOFF_BUCKETS - 1; us >>= 1)
+    bucket++;
+  irqsoff_hist[bucket]++;
+
+  if (ns > irqsoff_longest_ns)
+    {
+      irqsoff_longest_ns = ns;
+      irqsoff_longest_caller = cpu->irqsoff_caller;
+      irqsoff_longest_cpu = cpu->id;
+    }
+}
+
+/* Acquires the interrupt lock for the running CPU, whose
+   interrupts are off.  While spinning, services requests from
+   the lock's holder to flush our TLB, since it may be waiting
+   for that before it can release the lock. */
+static void
+intr_lock_acquire (void)
+{
+  while (!spinlock_try_acquire (&intr_lock))
+    {
+      smp_tlb_poll ();
+      cpu_relax ();
+    }
+}
+
 /* Initializes the interrupt system. */
 void
 intr_init (void)
 {
-  uint64_t idtr_operand;
   int i;
 
   /* Initialize interrupt controller. */
@@ -126,12 +289,7 @@ intr_init (void)
   /* Initialize IDT. */
   for (i = 0; i < INTR_CNT; i++)
     idt[i] = make_intr_gate (intr_stubs[i], 0);
-
-  /* Load IDT register.
-     See [IA32-v2a] "LIDT" and [IA32-v3a] 5.10 "Interrupt
-     Descriptor Table (IDT)". */
-  idtr_operand = make_idtr_operand (sizeof idt - 1, idt);
-  asm volatile ("lidt %0" : : "m" (idtr_operand));
+  load_idt ();
 
   /* Initialize intr_names. */
   for (i = 0; i < INTR_CNT; i++)
@@ -157,6 +315,30 @@ intr_init (void)
   intr_names[19] = "#XF SIMD Floating-Point Exception";
 }
 
+/* Initializes interrupt handling on an application processor,
+   which is running with interrupts off.  From now on the CPU
+   must hold the interrupt lock whenever its interrupts are
+   off. */
+void
+intr_init_ap (void)
+{
+  ASSERT (smp_active);
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  load_idt ();
+  intr_lock_acquire ();
+}
+
+/* Loads the IDT into the running CPU's IDT register.
+   See [IA32-v2a] "LIDT" and [IA32-v3a] 5.10 "Interrupt
+   Descriptor Table (IDT)". */
+static void
+load_idt (void)
+{
+  uint64_t idtr_operand = make_idtr_operand (sizeof idt - 1, idt);
+  asm volatile ("lidt %0" : : "m" (idtr_operand));
+}
+
 /* Registers interrupt VEC_NO to invoke HANDLER with descriptor
    privilege level DPL.  Names the interrupt NAME for debugging
    purposes.  The interrupt handler will be invoked with
@@ -181,7 +363,7 @@ void
 intr_register_ext (uint8_t vec_no, intr_handler_func *handler,
                    const char *name)
 {
-  ASSERT (vec_no >= 0x20 && vec_no <= 0x2f);
+  ASSERT (is_external (vec_no));
   register_handler (vec_no, 0, INTR_OFF, handler, name);
 }
 
@@ -202,7 +384,7 @@ void
 intr_register_int (uint8_t vec_no, int dpl, enum intr_level level,
                    intr_handler_func *handler, const char *name)
 {
-  ASSERT (vec_no < 0x20 || vec_no > 0x2f);
+  ASSERT (!is_external (vec_no));
   register_handler (vec_no, dpl, level, handler, name);
 }
 
@@ -211,7 +393,7 @@ intr_register_int (uint8_t vec_no, int dpl, enum intr_level level,
 bool
 intr_context (void)
 {
-  return in_external_intr;
+  return cpu_current ()->in_external_intr;
 }
 
 /* During processing of an external interrupt, directs the
@@ -222,7 +404,7 @@ void
 intr_yield_on_return (void)
 {
   ASSERT (intr_context ());
-  yield_on_return = true;
+  cpu_current ()->yield_on_return = true;
 }
 
 /* 8259A Programmable Interrupt Controller. */
@@ -344,28 +526,65 @@ make_idtr_operand (uint16_t limit, void *base)
 void
 intr_handler (struct intr_frame *frame)
 {
-  bool external;
+  bool external, gate_off, locked = false;
   intr_handler_func *handler;
+  struct cpu *cpu;
+
+  /* The holder of the interrupt lock may be waiting for this CPU
+     to flush its TLB, so a TLB shootdown is handled without
+     taking the lock. */
+  if (frame->vec_no == LAPIC_VEC_TLB)
+    {
+      intr_handlers[frame->vec_no] (frame);
+      lapic_eoi ();
+      return;
+    }
+
+  /* Entering an interrupt gate turned interrupts off.  Unless
+     they were already off, this CPU must now take the interrupt
+     lock. */
+  gate_off = intr_get_level () == INTR_OFF && (frame->eflags & FLAG_IF);
+  if (gate_off && irqsoff_enabled)
+    irqsoff_begin (intr_handlers[frame->vec_no]);
+  if (gate_off && smp_active)
+    {
+      intr_lock_acquire ();
+      locked = true;
+    }
 
   /* External interrupts are special.
      We only handle one at a time (so interrupts must be off)
-     and they need to be acknowledged on the PIC (see below).
-     An external interrupt handler cannot sleep. */
-  external = frame->vec_no >= 0x20 && frame->vec_no < 0x30;
+     and they need to be acknowledged on the PIC or local APIC
+     (see below).  An external interrupt handler cannot
+     sleep. */
+  external = is_external (frame->vec_no);
+  cpu = cpu_current ();
   if (external)
     {
       ASSERT (intr_get_level () == INTR_OFF);
       ASSERT (!intr_context ());
 
-      in_external_intr = true;
-      yield_on_return = false;
+      cpu->in_external_intr = true;
+      cpu->yield_on_return = false;
     }
 
   /* Invoke the interrupt's handler. */
   handler = intr_handlers[frame->vec_no];
-  if (handler != NULL)
+  if (handler != NULL && external)
+    {
+      uint64_t cycles = rdtsc ();
+      handler (frame);
+      cycles = rdtsc () - cycles;
+      if (cycles > longest_handler_cycles)
+        {
+          longest_handler_cycles = cycles;
+          longest_handler_vec = frame->vec_no;
+        }
+    }
+  else if (handler != NULL)
     handler (frame);
-  else if (frame->vec_no == 0x27 || frame->vec_no == 0x2f)
+  else if (frame->vec_no == 0x27 || frame->vec_no == 0x2f
+           || frame->vec_no == LAPIC_VEC_SPURIOUS)
     {
       /* There is no handler, but this interrupt can trigger
          spuriously due to a hardware fault or hardware race
@@ -380,14 +599,44 @@ intr_handler (struct intr_frame *frame)
       ASSERT (intr_get_level () == INTR_OFF);
       ASSERT (intr_context ());
 
-      in_external_intr = false;
-      pic_end_of_interrupt (frame->vec_no);
+      cpu->in_external_intr = false;
+      if (frame->vec_no >= LAPIC_VEC_FIRST)
+        lapic_eoi ();
+      else
+        pic_end_of_interrupt (frame->vec_no);
+
+      /* This thread may resume on another CPU, which then holds
+         the interrupt lock on our behalf.  A thread that has
+         disabled preemption yields when it enables it again
+         instead. */
+      if (cpu->yield_on_return)
+        {
+          if (thread_current ()->preempt_count == 0)
+            thread_yield ();
+          else
+            cpu->need_resched = true;
+        }
+    }
 
-      if (yield_on_return)
-        thread_yield ();
+  /* Returning to code that had interrupts on. */
+  if ((frame->eflags & FLAG_IF) && intr_get_level () == INTR_OFF)
+    {
+      if (irqsoff_enabled)
+        irqsoff_end ();
+      if (locked)
+        spinlock_release (&intr_lock);
     }
 }
 
+/* Returns true if VEC_NO is an external interrupt, raised by
+   the PIC or by the local APIC. */
+static bool
+is_external (uint8_t vec_no)
+{
+  return ((vec_no >= 0x20 && vec_no <= 0x2f)
+          || (vec_no >= LAPIC_VEC_FIRST && vec_no < LAPIC_VEC_SPURIOUS));
+}
+
 /* Handles an unexpected interrupt with interrupt frame F.  An
    unexpected interrupt is one that has no registered handler. */
 static void
@@ -430,6 +679,28 @@ intr_dump_frame (const struct intr_frame *f)
           f->cs, f->ds, f->es, f->ss);
 }
 
+/* Prints interrupt statistics. */
+void
+intr_print_stats (void)
+{
+  int i;
+
+  printf ("Interrupts: longest handler %"PRIu64" cycles (%s)\n",
+          longest_handler_cycles, intr_name (longest_handler_vec));
+
+  if (!irqsoff_enabled)
+    return;
+  printf ("Interrupts off: longest %"PRId64" ns on CPU %d, "
+          "turned off at %p\n",
+          irqsoff_longest_ns, irqsoff_longest_cpu, irqsoff_longest_caller);
+  for (i = 0; i < IRQSOFF_BUCKETS; i++)
+    if (irqsoff_hist[i] != 0)
+      printf ("  %s %5d us: %llu\n", i == 0 ? "< " : ">=",
+              i == 0 ? 1 : 1 << (i - 1), irqsoff_hist[i]);
+  printf ("The `backtrace' program can translate the address above "
+          "into a function.\n");
+}
+
 /* Returns the name of interrupt VEC. */
 const char *
 intr_name (uint8_t vec)
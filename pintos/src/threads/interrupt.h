@@ -11,10 +11,15 @@ enum intr_level
     INTR_ON               /* Interrupts enabled. */
   };
 
+/* If true, measure how long interrupts stay off.
+   Controlled by kernel command-line option "-irqsoff". */
+extern bool irqsoff_enabled;
+
 enum intr_level intr_get_level (void);
 enum intr_level intr_set_level (enum intr_level);
 enum intr_level intr_enable (void);
 enum intr_level intr_disable (void);
+void intr_enable_and_wait (void);
 
 /* Interrupt stack frame. */
 struct intr_frame
@@ -58,6 +63,7 @@ struct intr_frame
 typedef void intr_handler_func (struct intr_frame *);
 
 void intr_init (void);
+void intr_init_ap (void);
 void intr_register_ext (uint8_t vec, intr_handler_func *, const char *name);
 void intr_register_int (uint8_t vec, int dpl, enum intr_level,
                         intr_handler_func *, const char *name);
@@ -66,5 +72,6 @@ void intr_yield_on_return (void);
 
 void intr_dump_frame (const struct intr_frame *);
 const char *intr_name (uint8_t vec);
+void intr_print_stats (void);
 
 #endif /* threads/interrupt.h */
@@ -0,0 +1,131 @@
+#include "threads/lockstat.h"
+#include <debug.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "threads/interrupt.h"
+
+/* Lock profiling.
+
+   Each lock or semaphore that is given a name when it is
+   initialized, which lock_init() does for every lock, points to
+   the statistics of the class with that name, so that locks
+   created and destroyed by the thousand, like those in inodes,
+   add up to a single entry.  While lock profiling is disabled,
+   no lock points to any statistics, and lock_acquire() and its
+   relatives test a single pointer.
+
+   Classes are kept in a fixed array, since locks are initialized
+   before malloc() is.  Locks initialized once the array is full
+   are not profiled. */
+bool lockstat_enabled;
+
+#define CLASS_CNT 64            /* Maximum number of classes. */
+#define TOP_CNT 16              /* Number of classes printed. */
+static struct lockstat classes[CLASS_CNT];
+static size_t class_cnt;
+
+static int compare_wait (const void *, const void *);
+
+/* Returns the statistics of the class named NAME, creating it if
+   necessary, or a null pointer if lock profiling is disabled or
+   there is no room for another class.  NAME must remain valid
+   until shutdown. */
+struct lockstat *
+lockstat_register (const char *name)
+{
+  struct lockstat *ls = NULL;
+  enum intr_level old_level;
+  size_t i;
+
+  if (!lockstat_enabled || name == NULL)
+    return NULL;
+
+  old_level = intr_disable ();
+  for (i = 0; i < class_cnt; i++)
+    if (!strcmp (classes[i].name, name))
+      {
+        ls = &classes[i];
+        break;
+      }
+  if (ls == NULL && class_cnt < CLASS_CNT)
+    {
+      ls = &classes[class_cnt++];
+      ls->name = name;
+    }
+  intr_set_level (old_level);
+
+  return ls;
+}
+
+/* Records an acquisition in LS.  If CONTENDED, the acquirer had
+   to wait WAIT cycles. */
+void
+lockstat_acquired (struct lockstat *ls, bool contended, uint64_t wait)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  ls->acquisitions++;
+  if (contended)
+    {
+      ls->contentions++;
+      ls->wait_cycles += wait;
+      if (wait > ls->max_wait_cycles)
+        ls->max_wait_cycles = wait;
+    }
+}
+
+/* Records in LS that a lock was released after being held for
+   HOLD cycles. */
+void
+lockstat_released (struct lockstat *ls, uint64_t hold)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  ls->hold_cycles += hold;
+  if (hold > ls->max_hold_cycles)
+    ls->max_hold_cycles = hold;
+}
+
+/* Prints the TOP_CNT classes that waited longest, if lock
+   profiling is enabled. */
+void
+lockstat_print (void)
+{
+  struct lockstat *sorted[CLASS_CNT];
+  size_t i;
+
+  if (!lockstat_enabled)
+    return;
+
+  for (i = 0; i < class_cnt; i++)
+    sorted[i] = &classes[i];
+  qsort (sorted, class_cnt, sizeof *sorted, compare_wait);
+
+  printf ("Lockstat: %zu classes, cycles; acquisitions, contended, "
+          "wait total/max, hold total/max\n", class_cnt);
+  for (i = 0; i < class_cnt && i < TOP_CNT; i++)
+    {
+      struct lockstat *ls = sorted[i];
+      printf ("  %-20s %llu, %llu, %llu/%llu, %llu/%llu\n",
+              ls->name, ls->acquisitions, ls->contentions,
+              ls->wait_cycles, ls->max_wait_cycles,
+              ls->hold_cycles, ls->max_hold_cycles);
+    }
+}
+
+/* Orders pointers to struct lockstat by descending total wait,
+   then by descending number of acquisitions. */
+static int
+compare_wait (const void *a_, const void *b_)
+{
+  const struct lockstat *a = *(struct lockstat *const *) a_;
+  const struct lockstat *b = *(struct lockstat *const *) b_;
+
+  if (a->wait_cycles != b->wait_cycles)
+    return a->wait_cycles < b->wait_cycles ? 1 : -1;
+  else if (a->acquisitions != b->acquisitions)
+    return a->acquisitions < b->acquisitions ? 1 : -1;
+  else
+    return 0;
+}
@@ -0,0 +1,30 @@
+#ifndef THREADS_LOCKSTAT_H
+#define THREADS_LOCKSTAT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Contention statistics for a class of locks or semaphores: all
+   those initialized with the same name.  Times are in TSC
+   cycles.  Updated with interrupts off. */
+struct lockstat
+  {
+    const char *name;                   /* Class name. */
+    unsigned long long acquisitions;    /* Times acquired. */
+    unsigned long long contentions;     /* Acquisitions that had to wait. */
+    uint64_t wait_cycles;               /* Total time spent waiting. */
+    uint64_t max_wait_cycles;           /* Longest wait. */
+    uint64_t hold_cycles;               /* Total time held (locks only). */
+    uint64_t max_hold_cycles;           /* Longest hold (locks only). */
+  };
+
+/* If true, gather lock statistics and print them at shutdown.
+   Controlled by kernel command-line option "-lockstat". */
+extern bool lockstat_enabled;
+
+struct lockstat *lockstat_register (const char *name);
+void lockstat_acquired (struct lockstat *, bool contended, uint64_t wait);
+void lockstat_released (struct lockstat *, uint64_t hold);
+void lockstat_print (void);
+
+#endif /* threads/lockstat.h */
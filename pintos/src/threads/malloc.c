@@ -5,8 +5,11 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include "threads/interrupt.h"
 #include "threads/palloc.h"
+#include "threads/smp.h"
 #include "threads/synch.h"
+#include "threads/thread.h"
 #include "threads/vaddr.h"
 
 /* A simple implementation of malloc().
@@ -26,7 +29,21 @@
    When we free a block, we add it to its descriptor's free list.
    But if the arena that the block was in now has no in-use
    blocks, we remove all of the arena's blocks from the free list
-   and give the arena back to the page allocator.
+   and give the arena back to the page allocator, unless the
+   descriptor holds fewer than EMPTY_MAX empty arenas, in which
+   case we keep it.  That stops a block that is allocated and
+   freed over and over from taking a page from the page allocator
+   and giving it back each time.
+
+   In front of each descriptor, each CPU has a "magazine" of a few
+   free blocks, which malloc() takes from and free() returns to
+   with preemption disabled but without taking the descriptor's
+   lock.  Only when a CPU's magazine is empty does malloc() take
+   the lock, to get a block plus about half a magazine's worth
+   more, and only when it is full does free() take the lock, to
+   give back half of it.  Blocks in a magazine count as in use in
+   their arenas.  Neither function may be called from an
+   interrupt handler.
 
    We can't handle blocks bigger than 2 kB using this scheme,
    because they're too big to fit in a single page with a
@@ -34,13 +51,39 @@
    with the page allocator and sticking the allocation size at
    the beginning of the allocated block's arena header. */
 
+#define DESC_MAX 10             /* Maximum number of descriptors. */
+#define MAG_SIZE 16             /* Maximum blocks in a magazine. */
+#define EMPTY_MAX 2             /* Empty arenas kept per descriptor. */
+
 /* Descriptor. */
 struct desc
   {
     size_t block_size;          /* Size of each element in bytes. */
     size_t blocks_per_arena;    /* Number of blocks in an arena. */
+    size_t mag_size;            /* Capacity of each CPU's magazine. */
     struct list free_list;      /* List of free blocks. */
     struct lock lock;           /* Lock. */
+    char name[16];              /* Name of lock, for lock profiling. */
+
+    /* Protected by `lock'. */
+    size_t empty_cnt;           /* Number of arenas with no block in use. */
+    size_t arena_cnt;           /* Number of arenas. */
+    size_t arena_peak;          /* Maximum of arena_cnt. */
+    unsigned long long arenas_created;  /* Pages taken from palloc. */
+    unsigned long long arenas_freed;    /* Pages given back to palloc. */
+  };
+
+/* A CPU's cache of free blocks for one descriptor.
+   Owned by that CPU, and accessed only with preemption
+   disabled. */
+struct magazine
+  {
+    size_t cnt;                         /* Number of blocks. */
+    struct block *blocks[MAG_SIZE];     /* Blocks, most recent last. */
+    unsigned long long alloc_hits;      /* malloc()s from blocks. */
+    unsigned long long alloc_misses;    /* malloc()s that found it empty. */
+    unsigned long long free_hits;       /* free()s into blocks. */
+    unsigned long long free_misses;     /* free()s that found it full. */
   };
 
 /* Magic number for detecting arena corruption. */
@@ -61,11 +104,17 @@ struct block
   };
 
 /* Our set of descriptors. */
-static struct desc descs[10];   /* Descriptors. */
-static size_t desc_cnt;         /* Number of descriptors. */
+static struct desc descs[DESC_MAX];     /* Descriptors. */
+static size_t desc_cnt;                 /* Number of descriptors. */
+
+/* Each CPU's magazines, indexed by CPU and descriptor. */
+static struct magazine magazines[CPU_MAX][DESC_MAX];
 
 static struct arena *block_to_arena (struct block *);
 static struct block *arena_to_block (struct arena *, size_t idx);
+static struct magazine *get_magazine (struct desc *);
+static size_t desc_alloc (struct desc *, struct block **, size_t cnt);
+static void desc_free (struct desc *, struct block **, size_t cnt);
 
 /* Initializes the malloc() descriptors. */
 void
@@ -79,8 +128,11 @@ malloc_init (void)
       ASSERT (desc_cnt <= sizeof descs / sizeof *descs);
       d->block_size = block_size;
       d->blocks_per_arena = (PGSIZE - sizeof (struct arena)) / block_size;
+      d->mag_size = (d->blocks_per_arena < MAG_SIZE
+                     ? d->blocks_per_arena : MAG_SIZE);
       list_init (&d->free_list);
-      lock_init (&d->lock);
+      snprintf (d->name, sizeof d->name, "malloc %zu", block_size);
+      lock_init_named (&d->lock, d->name);
     }
 }
 
@@ -92,6 +144,11 @@ malloc (size_t size)
   struct desc *d;
   struct block *b;
   struct arena *a;
+  struct magazine *m;
+  struct block *batch[MAG_SIZE];
+  size_t cnt;
+
+  ASSERT (!intr_context ());
 
   /* A null pointer satisfies a request for 0 bytes. */
   if (size == 0)
@@ -119,38 +176,35 @@ malloc (size_t size)
       return a + 1;
     }
 
-  lock_acquire (&d->lock);
-
-  /* If the free list is empty, create a new arena. */
-  if (list_empty (&d->free_list))
+  /* Take a block from this CPU's magazine, if it has one. */
+  m = get_magazine (d);
+  if (m->cnt > 0)
     {
-      size_t i;
-
-      /* Allocate a page. */
-      a = palloc_get_page (0);
-      if (a == NULL)
-        {
-          lock_release (&d->lock);
-          return NULL;
-        }
-
-      /* Initialize arena and add its blocks to the free list. */
-      a->magic = ARENA_MAGIC;
-      a->desc = d;
-      a->free_cnt = d->blocks_per_arena;
-      for (i = 0; i < d->blocks_per_arena; i++)
-        {
-          struct block *b = arena_to_block (a, i);
-          list_push_back (&d->free_list, &b->free_elem);
-        }
+      b = m->blocks[--m->cnt];
+      m->alloc_hits++;
+      preempt_enable ();
+      return b;
     }
-
-  /* Get a block from free list and return it. */
-  b = list_entry (list_pop_front (&d->free_list), struct block, free_elem);
-  a = block_to_arena (b);
-  a->free_cnt--;
-  lock_release (&d->lock);
-  return b;
+  m->alloc_misses++;
+  preempt_enable ();
+
+  /* Otherwise get a block from the descriptor, along with about
+     half a magazine more, and put those in whatever CPU's
+     magazine we are on now.  Anything that does not fit, because
+     the magazine filled up meanwhile, goes back. */
+  cnt = desc_alloc (d, batch, d->mag_size / 2 + 1);
+  if (cnt == 0)
+    return NULL;
+  if (cnt > 1)
+    {
+      m = get_magazine (d);
+      while (cnt > 1 && m->cnt < d->mag_size)
+        m->blocks[m->cnt++] = batch[--cnt];
+      preempt_enable ();
+      if (cnt > 1)
+        desc_free (d, batch + 1, cnt - 1);
+    }
+  return batch[0];
 }
 
 /* Allocates and return A times B bytes initialized to zeroes.
@@ -218,11 +272,16 @@ realloc (void *old_block, size_t new_size)
 void
 free (void *p)
 {
+  ASSERT (!intr_context ());
+
   if (p != NULL)
     {
       struct block *b = p;
       struct arena *a = block_to_arena (b);
       struct desc *d = a->desc;
+      struct magazine *m;
+      struct block *batch[MAG_SIZE];
+      size_t cnt;
 
       if (d != NULL)
         {
@@ -233,26 +292,25 @@ free (void *p)
           memset (b, 0xcc, d->block_size);
 #endif
 
-          lock_acquire (&d->lock);
-
-          /* Add block to free list. */
-          list_push_front (&d->free_list, &b->free_elem);
-
-          /* If the arena is now entirely unused, free it. */
-          if (++a->free_cnt >= d->blocks_per_arena)
+          /* Put the block in this CPU's magazine, if it has room. */
+          m = get_magazine (d);
+          if (m->cnt < d->mag_size)
             {
-              size_t i;
-
-              ASSERT (a->free_cnt == d->blocks_per_arena);
-              for (i = 0; i < d->blocks_per_arena; i++)
-                {
-                  struct block *b = arena_to_block (a, i);
-                  list_remove (&b->free_elem);
-                }
-              palloc_free_page (a);
+              m->blocks[m->cnt++] = b;
+              m->free_hits++;
+              preempt_enable ();
+              return;
             }
 
-          lock_release (&d->lock);
+          /* Otherwise give half of the magazine back to the
+             descriptor, along with the block. */
+          m->free_misses++;
+          cnt = d->mag_size / 2;
+          m->cnt -= cnt;
+          memcpy (batch, m->blocks + m->cnt, cnt * sizeof *batch);
+          preempt_enable ();
+          batch[cnt++] = b;
+          desc_free (d, batch, cnt);
         }
       else
         {
@@ -263,6 +321,161 @@ free (void *p)
     }
 }
 
+/* Returns the number of blocks that malloc() carves out of each
+   page for a SIZE-byte request, or 0 if it gives such a request
+   pages of its own. */
+size_t
+malloc_blocks_per_page (size_t size)
+{
+  struct desc *d;
+
+  for (d = descs; d < descs + desc_cnt; d++)
+    if (d->block_size >= size)
+      return d->blocks_per_arena;
+  return 0;
+}
+
+/* Prints, for each descriptor that has been used, how often
+   malloc() and free() found what they needed in a magazine, and
+   how many arenas it has had. */
+void
+malloc_print_stats (void)
+{
+  struct desc *d;
+
+  printf ("Malloc: size, allocs, magazine misses, frees, magazine misses, "
+          "arenas now/peak/empty, created/freed\n");
+  for (d = descs; d < descs + desc_cnt; d++)
+    {
+      unsigned long long allocs = 0, alloc_misses = 0;
+      unsigned long long frees = 0, free_misses = 0;
+      int cpu;
+
+      for (cpu = 0; cpu < CPU_MAX; cpu++)
+        {
+          struct magazine *m = &magazines[cpu][d - descs];
+          allocs += m->alloc_hits + m->alloc_misses;
+          alloc_misses += m->alloc_misses;
+          frees += m->free_hits + m->free_misses;
+          free_misses += m->free_misses;
+        }
+      if (allocs == 0)
+        continue;
+
+      lock_acquire (&d->lock);
+      printf ("  %4zu %llu, %llu, %llu, %llu, %zu/%zu/%zu, %llu/%llu\n",
+              d->block_size, allocs, alloc_misses, frees, free_misses,
+              d->arena_cnt, d->arena_peak, d->empty_cnt,
+              d->arenas_created, d->arenas_freed);
+      lock_release (&d->lock);
+    }
+}
+
+/* Disables preemption and returns the running CPU's magazine for
+   descriptor D.  The caller must reenable preemption when it is
+   done with the magazine. */
+static struct magazine *
+get_magazine (struct desc *d)
+{
+  preempt_disable ();
+  return &magazines[thread_current ()->cpu->id][d - descs];
+}
+
+/* Takes up to CNT blocks from descriptor D, creating arenas as
+   needed, and stores them in BLOCKS.  Returns the number of
+   blocks obtained, which is less than CNT only if memory ran
+   out. */
+static size_t
+desc_alloc (struct desc *d, struct block **blocks, size_t cnt)
+{
+  size_t got;
+
+  lock_acquire (&d->lock);
+  for (got = 0; got < cnt; got++)
+    {
+      struct block *b;
+      struct arena *a;
+
+      /* If the free list is empty, create a new arena. */
+      if (list_empty (&d->free_list))
+        {
+          size_t i;
+
+          /* Allocate a page. */
+          a = palloc_get_page (0);
+          if (a == NULL)
+            break;
+          d->arenas_created++;
+          if (++d->arena_cnt > d->arena_peak)
+            d->arena_peak = d->arena_cnt;
+          d->empty_cnt++;
+
+          /* Initialize arena and add its blocks to the free list. */
+          a->magic = ARENA_MAGIC;
+          a->desc = d;
+          a->free_cnt = d->blocks_per_arena;
+          for (i = 0; i < d->blocks_per_arena; i++)
+            {
+              struct block *b = arena_to_block (a, i);
+              list_push_back (&d->free_list, &b->free_elem);
+            }
+        }
+
+      /* Get a block from free list. */
+      b = list_entry (list_pop_front (&d->free_list),
+                      struct block, free_elem);
+      a = block_to_arena (b);
+      if (a->free_cnt-- == d->blocks_per_arena)
+        d->empty_cnt--;
+      blocks[got] = b;
+    }
+  lock_release (&d->lock);
+
+  return got;
+}
+
+/* Returns the CNT blocks in BLOCKS to descriptor D, giving back
+   to the page allocator any arena that they leave empty, beyond
+   the first EMPTY_MAX. */
+static void
+desc_free (struct desc *d, struct block **blocks, size_t cnt)
+{
+  size_t i;
+
+  lock_acquire (&d->lock);
+  for (i = 0; i < cnt; i++)
+    {
+      struct block *b = blocks[i];
+      struct arena *a = block_to_arena (b);
+
+      /* Add block to free list. */
+      list_push_front (&d->free_list, &b->free_elem);
+
+      /* If the arena is now entirely unused, keep it or free
+         it. */
+      if (++a->free_cnt >= d->blocks_per_arena)
+        {
+          size_t j;
+
+          ASSERT (a->free_cnt == d->blocks_per_arena);
+          if (d->empty_cnt < EMPTY_MAX)
+            {
+              d->empty_cnt++;
+              continue;
+            }
+          for (j = 0; j < d->blocks_per_arena; j++)
+            {
+              struct block *b = arena_to_block (a, j);
+              list_remove (&b->free_elem);
+            }
+          palloc_free_page (a);
+          d->arena_cnt--;
+          d->arenas_freed++;
+        }
+    }
+  lock_release (&d->lock);
+}
+
 /* Returns the arena that block B is inside. */
 static struct arena *
 block_to_arena (struct block *b)
@@ -1,14 +1,14 @@
 #include "threads/palloc.h"
-#include <bitmap.h>
 #include <debug.h>
 #include <inttypes.h>
+#include <list.h>
 #include <round.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include "threads/interrupt.h"
 #include "threads/loader.h"
-#include "threads/synch.h"
 #include "threads/vaddr.h"
 
 /* Page allocator.  Hands out memory in page-size (or
@@ -25,11 +25,44 @@
    half to the user pool.  That should be huge overkill for the
    kernel pool, but that's just fine for demonstration purposes. */
 
+/* Buddy allocation.
+
+   Each pool's pages are handed out in blocks of 2**ORDER pages,
+   for ORDER from 0 to ORDER_CNT - 1, each aligned on a multiple
+   of its size, counting from the pool's base.  The two halves
+   of a block of order K + 1 are "buddies" of order K, so the
+   buddy of the block at page index I is at I ^ (1 << K).
+
+   Free blocks are kept in one list per order, linked through a
+   list_elem at the start of each block's first page, so the
+   free pages themselves hold the lists.  A byte per page, in
+   `orders', is PAGE_FREE | K for the first page of a free block
+   of order K, and 0 for every other page, which tells in
+   constant time whether a block's buddy is free too.
+
+   Allocating PAGE_CNT pages takes the smallest free block of at
+   least that many pages, found by walking up at most ORDER_CNT
+   lists, splits it in halves down to the order needed, and
+   gives back the pages beyond PAGE_CNT.  Freeing a block merges
+   it with its buddy for as long as the buddy is free, again at
+   most ORDER_CNT steps.  A range of pages that is not a single
+   block, like the pool itself or the tail of an allocation, is
+   freed as the largest aligned blocks that it divides into.
+
+   The pools are protected by disabling interrupts rather than by
+   a lock, because pages are freed from contexts that cannot
+   sleep, such as thread_schedule_tail() freeing a dead thread's
+   page. */
+#define ORDER_CNT 14            /* Blocks of up to 8192 pages. */
+#define PAGE_FREE 0x80          /* In `orders': first page of free block. */
+
 /* A memory pool. */
 struct pool
   {
-    struct lock lock;                   /* Mutual exclusion. */
-    struct bitmap *used_map;            /* Bitmap of free pages. */
+    uint8_t *orders;                    /* PAGE_FREE | order, by page. */
+    struct list free[ORDER_CNT];        /* Free blocks, by order. */
+    size_t free_cnt[ORDER_CNT];         /* Lengths of `free' lists. */
+    size_t page_cnt;                    /* Number of pages. */
     uint8_t *base;                      /* Base of pool. */
   };
 
@@ -39,6 +72,11 @@ static struct pool kernel_pool, user_pool;
 static void init_pool (struct pool *, void *base, size_t page_cnt,
                        const char *name);
 static bool page_from_pool (const struct pool *, void *page);
+static size_t alloc_pages (struct pool *, size_t page_cnt);
+static void free_range (struct pool *, size_t page_idx, size_t page_cnt);
+static void free_block (struct pool *, size_t page_idx, int order);
+static bool page_is_free (const struct pool *, size_t page_idx);
+static void print_pool (const char *name, struct pool *);
 
 /* Initializes the page allocator.  At most USER_PAGE_LIMIT
    pages are put into the user pool. */
@@ -71,17 +109,18 @@ void *
 palloc_get_multiple (enum palloc_flags flags, size_t page_cnt)
 {
   struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
+  enum intr_level old_level;
   void *pages;
   size_t page_idx;
 
   if (page_cnt == 0)
     return NULL;
 
-  lock_acquire (&pool->lock);
-  page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt, false);
-  lock_release (&pool->lock);
+  old_level = intr_disable ();
+  page_idx = alloc_pages (pool, page_cnt);
+  intr_set_level (old_level);
 
-  if (page_idx != BITMAP_ERROR)
+  if (page_idx != SIZE_MAX)
     pages = pool->base + PGSIZE * page_idx;
   else
     pages = NULL;
@@ -122,6 +161,7 @@ void
 palloc_free_multiple (void *pages, size_t page_cnt)
 {
   struct pool *pool;
+  enum intr_level old_level;
   size_t page_idx;
 
   ASSERT (pg_ofs (pages) == 0);
@@ -138,11 +178,22 @@ palloc_free_multiple (void *pages, size_t page_cnt)
   page_idx = pg_no (pages) - pg_no (pool->base);
 
 #ifndef NDEBUG
+  {
+    size_t i;
+
+    /* Catch a double free before the memset() below clobbers the
+       free lists held in the pages. */
+    old_level = intr_disable ();
+    for (i = 0; i < page_cnt; i++)
+      ASSERT (!page_is_free (pool, page_idx + i));
+    intr_set_level (old_level);
+  }
   memset (pages, 0xcc, PGSIZE * page_cnt);
 #endif
 
-  ASSERT (bitmap_all (pool->used_map, page_idx, page_cnt));
-  bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+  old_level = intr_disable ();
+  free_range (pool, page_idx, page_cnt);
+  intr_set_level (old_level);
 }
 
 /* Frees the page at PAGE. */
@@ -152,25 +203,43 @@ palloc_free_page (void *page)
   palloc_free_multiple (page, 1);
 }
 
+/* Prints the number of free blocks of each order in each pool,
+   which shows how fragmented free memory is. */
+void
+palloc_print_stats (void)
+{
+  print_pool ("kernel", &kernel_pool);
+  print_pool ("user", &user_pool);
+}
+
 /* Initializes pool P as starting at START and ending at END,
    naming it NAME for debugging purposes. */
 static void
 init_pool (struct pool *p, void *base, size_t page_cnt, const char *name)
 {
-  /* We'll put the pool's used_map at its base.
-     Calculate the space needed for the bitmap
+  /* We'll put the pool's page orders at its base.
+     Calculate the space needed for them
      and subtract it from the pool's size. */
-  size_t bm_pages = DIV_ROUND_UP (bitmap_buf_size (page_cnt), PGSIZE);
-  if (bm_pages > page_cnt)
-    PANIC ("Not enough memory in %s for bitmap.", name);
-  page_cnt -= bm_pages;
+  size_t meta_pages = DIV_ROUND_UP (page_cnt, PGSIZE);
+  int order;
+
+  if (meta_pages > page_cnt)
+    PANIC ("Not enough memory in %s for page orders.", name);
+  page_cnt -= meta_pages;
 
   printf ("%zu pages available in %s.\n", page_cnt, name);
 
-  /* Initialize the pool. */
-  lock_init (&p->lock);
-  p->used_map = bitmap_create_in_buf (page_cnt, base, bm_pages * PGSIZE);
-  p->base = base + bm_pages * PGSIZE;
+  /* Initialize the pool, with every page free. */
+  p->orders = base;
+  memset (p->orders, 0, page_cnt);
+  for (order = 0; order < ORDER_CNT; order++)
+    {
+      list_init (&p->free[order]);
+      p->free_cnt[order] = 0;
+    }
+  p->page_cnt = page_cnt;
+  p->base = base + meta_pages * PGSIZE;
+  free_range (p, 0, page_cnt);
 }
 
 /* Returns true if PAGE was allocated from POOL,
@@ -180,7 +249,155 @@ page_from_pool (const struct pool *pool, void *page)
 {
   size_t page_no = pg_no (page);
   size_t start_page = pg_no (pool->base);
-  size_t end_page = start_page + bitmap_size (pool->used_map);
+  size_t end_page = start_page + pool->page_cnt;
 
   return page_no >= start_page && page_no < end_page;
 }
+
+/* Returns the list element at the start of the block at
+   PAGE_IDX in POOL. */
+static struct list_elem *
+block_elem (struct pool *pool, size_t page_idx)
+{
+  return (struct list_elem *) (pool->base + PGSIZE * page_idx);
+}
+
+/* Returns the index in POOL of the block whose list element is
+   E. */
+static size_t
+elem_block (struct pool *pool, struct list_elem *e)
+{
+  return ((uint8_t *) e - pool->base) / PGSIZE;
+}
+
+/* Allocates PAGE_CNT contiguous pages from POOL, with interrupts
+   off, and returns the index of the first, or SIZE_MAX if
+   there is no free block big enough. */
+static size_t
+alloc_pages (struct pool *pool, size_t page_cnt)
+{
+  int need = 0, order;
+  size_t page_idx;
+
+  while (((size_t) 1 << need) < page_cnt)
+    if (++need >= ORDER_CNT)
+      return SIZE_MAX;
+
+  for (order = need; order < ORDER_CNT; order++)
+    if (!list_empty (&pool->free[order]))
+      break;
+  if (order >= ORDER_CNT)
+    return SIZE_MAX;
+
+  page_idx = elem_block (pool, list_pop_front (&pool->free[order]));
+  pool->free_cnt[order]--;
+  pool->orders[page_idx] = 0;
+
+  /* Split the block, freeing the upper halves, until it is of
+     the order needed, then free the pages beyond PAGE_CNT. */
+  while (order > need)
+    {
+      size_t buddy;
+
+      order--;
+      buddy = page_idx + ((size_t) 1 << order);
+      pool->orders[buddy] = PAGE_FREE | order;
+      list_push_front (&pool->free[order], block_elem (pool, buddy));
+      pool->free_cnt[order]++;
+    }
+  if (page_cnt < ((size_t) 1 << need))
+    free_range (pool, page_idx + page_cnt,
+                ((size_t) 1 << need) - page_cnt);
+  return page_idx;
+}
+
+/* Frees the PAGE_CNT pages in POOL starting at PAGE_IDX, with
+   interrupts off, as the largest aligned blocks that they divide
+   into. */
+static void
+free_range (struct pool *pool, size_t page_idx, size_t page_cnt)
+{
+  ASSERT (page_idx + page_cnt <= pool->page_cnt);
+
+  while (page_cnt > 0)
+    {
+      int order = 0;
+
+      while (order + 1 < ORDER_CNT
+             && page_idx % ((size_t) 2 << order) == 0
+             && ((size_t) 2 << order) <= page_cnt)
+        order++;
+      free_block (pool, page_idx, order);
+      page_idx += (size_t) 1 << order;
+      page_cnt -= (size_t) 1 << order;
+    }
+}
+
+/* Frees the block of order ORDER at PAGE_IDX in POOL, with
+   interrupts off, merging it with its buddy as long as the buddy
+   is free. */
+static void
+free_block (struct pool *pool, size_t page_idx, int order)
+{
+  ASSERT (pool->orders[page_idx] == 0);
+
+  for (; order + 1 < ORDER_CNT; order++)
+    {
+      size_t buddy = page_idx ^ ((size_t) 1 << order);
+
+      if (buddy + ((size_t) 1 << order) > pool->page_cnt
+          || pool->orders[buddy] != (PAGE_FREE | order))
+        break;
+      list_remove (block_elem (pool, buddy));
+      pool->free_cnt[order]--;
+      pool->orders[buddy] = 0;
+      if (buddy < page_idx)
+        page_idx = buddy;
+    }
+
+  pool->orders[page_idx] = PAGE_FREE | order;
+  list_push_front (&pool->free[order], block_elem (pool, page_idx));
+  pool->free_cnt[order]++;
+}
+
+/* Returns true if the page at PAGE_IDX in POOL lies in a free
+   block.  Blocks are aligned on their size, so the only block of
+   order K that can hold it starts at PAGE_IDX rounded down to a
+   multiple of 2**K. */
+static bool
+page_is_free (const struct pool *pool, size_t page_idx)
+{
+  int order;
+
+  for (order = 0; order < ORDER_CNT; order++)
+    {
+      size_t start = page_idx & ~(((size_t) 1 << order) - 1);
+
+      if (pool->orders[start] == (PAGE_FREE | order))
+        return true;
+    }
+  return false;
+}
+
+/* Prints the number of free blocks of each order in POOL, named
+   NAME. */
+static void
+print_pool (const char *name, struct pool *pool)
+{
+  size_t free_cnt[ORDER_CNT];
+  size_t total = 0;
+  enum intr_level old_level;
+  int order;
+
+  old_level = intr_disable ();
+  memcpy (free_cnt, pool->free_cnt, sizeof free_cnt);
+  intr_set_level (old_level);
+
+  for (order = 0; order < ORDER_CNT; order++)
+    total += free_cnt[order] << order;
+  printf ("Palloc: %s pool, %zu of %zu pages free; free blocks by order:",
+          name, total, pool->page_cnt);
+  for (order = 0; order < ORDER_CNT; order++)
+    printf (" %zu", free_cnt[order]);
+  printf ("\n");
+}
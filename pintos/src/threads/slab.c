@@ -0,0 +1,320 @@
+#include "threads/slab.h"
+#include <debug.h>
+#include <list.h>
+#include <round.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "threads/interrupt.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* Object caches.
+
+   A cache hands out objects of one size, packed into "slabs" of
+   one page each, rather than rounding each object up to a power
+   of 2 as malloc() does.  An object's slot is aligned on the
+   smallest power of 2, up to a cache line, that is at least as
+   big as the object, or on a cache line for objects bigger than
+   that, so that no object spans more cache lines than it must.
+
+   An optional constructor runs on each object when its slab is
+   created, and an optional destructor when the slab is given
+   back to the page allocator.  In between, objects go back to
+   the cache in their constructed state, so that state that is
+   the same in every free object, like an unheld lock, need not
+   be set up again on every allocation.  For the same reason,
+   the slab keeps its free list as a stack of object indexes
+   after its header, not in the free objects themselves.
+
+   Each cache keeps lists of its partially used, fully used, and
+   empty slabs.  Allocation takes an object from a partially used
+   slab, then from an empty one, and only then from a new slab.
+   A cache keeps at most EMPTY_MAX empty slabs; a slab that
+   empties beyond that is destroyed.
+
+   Caches are kept in a fixed array, since they live as long as
+   the kernel. */
+
+#define CACHE_MAX 16            /* Maximum number of caches. */
+#define CACHE_LINE 64           /* Cache line size, in bytes. */
+#define EMPTY_MAX 1             /* Empty slabs kept per cache. */
+
+/* An object cache. */
+struct kmem_cache
+  {
+    const char *name;           /* Name, for statistics. */
+    size_t obj_size;            /* Size of an object. */
+    size_t slot_size;           /* Size of an object's slot in a slab. */
+    size_t obj_ofs;             /* Offset of first slot in a slab. */
+    size_t obj_cnt;             /* Objects per slab. */
+    kmem_ctor_func *ctor;       /* Constructor, or null. */
+    kmem_ctor_func *dtor;       /* Destructor, or null. */
+
+    struct lock lock;           /* Protects the rest. */
+    struct list partial;        /* Slabs with free and used objects. */
+    struct list full;           /* Slabs with no free objects. */
+    struct list empty;          /* Slabs with no used objects. */
+    size_t empty_cnt;           /* Length of `empty'. */
+
+    /* Statistics. */
+    unsigned long long allocs;  /* Number of kmem_cache_alloc() calls. */
+    size_t in_use;              /* Objects in use. */
+    size_t in_use_peak;         /* Maximum of in_use. */
+    size_t slab_cnt;            /* Number of slabs. */
+    size_t slab_peak;           /* Maximum of slab_cnt. */
+  };
+
+/* Magic number for detecting slab corruption. */
+#define SLAB_MAGIC 0x51ab51ab
+
+/* A slab, at the start of its page. */
+struct slab
+  {
+    unsigned magic;             /* Always SLAB_MAGIC. */
+    struct kmem_cache *cache;   /* Owning cache. */
+    struct list_elem elem;      /* In one of the cache's lists. */
+    size_t free_cnt;            /* Number of free objects. */
+    uint16_t free[];            /* Indexes of free objects, in free[0
+                                   through free_cnt - 1]. */
+  };
+
+static struct kmem_cache caches[CACHE_MAX];
+static size_t cache_cnt;
+
+static struct slab *slab_create (struct kmem_cache *);
+static void slab_destroy (struct kmem_cache *, struct slab *);
+static void *slab_obj (struct kmem_cache *, struct slab *, size_t idx);
+
+/* Creates and returns a cache of SIZE-byte objects named NAME,
+   which must remain valid until shutdown.  CTOR, if nonnull, is
+   called on each object before it is first allocated, and DTOR,
+   if nonnull, on each object before its memory is given back to
+   the page allocator.  Panics if there are too many caches or
+   SIZE is too big for a slab to hold two objects. */
+struct kmem_cache *
+kmem_cache_create (const char *name, size_t size,
+                   kmem_ctor_func *ctor, kmem_ctor_func *dtor)
+{
+  struct kmem_cache *c;
+  enum intr_level old_level;
+  size_t align, hdr;
+
+  ASSERT (size > 0);
+
+  old_level = intr_disable ();
+  if (cache_cnt >= CACHE_MAX)
+    PANIC ("too many object caches");
+  c = &caches[cache_cnt++];
+  intr_set_level (old_level);
+
+  align = CACHE_LINE;
+  while (align / 2 >= size && align > sizeof (void *))
+    align /= 2;
+
+  c->name = name;
+  c->obj_size = size;
+  c->slot_size = ROUND_UP (size, align);
+
+  /* Fit as many slots as possible after the header and its free
+     stack. */
+  c->obj_cnt = (PGSIZE - sizeof (struct slab)) / (c->slot_size
+                                                  + sizeof (uint16_t));
+  for (;;)
+    {
+      hdr = sizeof (struct slab) + c->obj_cnt * sizeof (uint16_t);
+      c->obj_ofs = ROUND_UP (hdr, align);
+      if (c->obj_ofs + c->obj_cnt * c->slot_size <= PGSIZE)
+        break;
+      c->obj_cnt--;
+    }
+  if (c->obj_cnt < 2)
+    PANIC ("%zu-byte objects are too big for a slab", size);
+
+  c->ctor = ctor;
+  c->dtor = dtor;
+  lock_init_named (&c->lock, name);
+  list_init (&c->partial);
+  list_init (&c->full);
+  list_init (&c->empty);
+  c->empty_cnt = 0;
+  return c;
+}
+
+/* Allocates and returns an object from cache C, or a null
+   pointer if memory is not available.  The object is in the
+   state its constructor, or the object's last user, left it. */
+void *
+kmem_cache_alloc (struct kmem_cache *c)
+{
+  struct slab *s;
+  void *obj;
+
+  lock_acquire (&c->lock);
+  if (!list_empty (&c->partial))
+    s = list_entry (list_front (&c->partial), struct slab, elem);
+  else
+    {
+      if (!list_empty (&c->empty))
+        {
+          s = list_entry (list_pop_front (&c->empty), struct slab, elem);
+          c->empty_cnt--;
+        }
+      else
+        {
+          s = slab_create (c);
+          if (s == NULL)
+            {
+              lock_release (&c->lock);
+              return NULL;
+            }
+        }
+      list_push_front (&c->partial, &s->elem);
+    }
+
+  obj = slab_obj (c, s, s->free[--s->free_cnt]);
+  if (s->free_cnt == 0)
+    {
+      list_remove (&s->elem);
+      list_push_front (&c->full, &s->elem);
+    }
+
+  c->allocs++;
+  if (++c->in_use > c->in_use_peak)
+    c->in_use_peak = c->in_use;
+  lock_release (&c->lock);
+
+  return obj;
+}
+
+/* Returns OBJ, which must have been allocated from cache C, to
+   C.  Does nothing if OBJ is a null pointer. */
+void
+kmem_cache_free (struct kmem_cache *c, void *obj)
+{
+  struct slab *s;
+  size_t ofs;
+
+  if (obj == NULL)
+    return;
+
+  s = pg_round_down (obj);
+  ofs = pg_ofs (obj) - c->obj_ofs;
+  ASSERT (s->magic == SLAB_MAGIC);
+  ASSERT (s->cache == c);
+  ASSERT (ofs % c->slot_size == 0);
+
+  lock_acquire (&c->lock);
+  ASSERT (s->free_cnt < c->obj_cnt);
+  if (s->free_cnt == 0)
+    {
+      list_remove (&s->elem);
+      list_push_front (&c->partial, &s->elem);
+    }
+  s->free[s->free_cnt++] = ofs / c->slot_size;
+  c->in_use--;
+
+  /* Keep the slab for later if it is now empty, unless we
+     already have enough empty slabs. */
+  if (s->free_cnt == c->obj_cnt)
+    {
+      list_remove (&s->elem);
+      if (c->empty_cnt < EMPTY_MAX)
+        {
+          list_push_front (&c->empty, &s->elem);
+          c->empty_cnt++;
+        }
+      else
+        slab_destroy (c, s);
+    }
+  lock_release (&c->lock);
+}
+
+/* Prints the use of each cache, along with how many pages
+   malloc() would have needed for the most objects each had in
+   use at once. */
+void
+kmem_print_stats (void)
+{
+  size_t slab_pages = 0, malloc_pages = 0;
+  size_t i;
+
+  if (cache_cnt == 0)
+    return;
+
+  printf ("Slab: cache, size/slot, objs/slab, allocs, in use now/peak, "
+          "slabs now/peak, malloc pages at peak\n");
+  for (i = 0; i < cache_cnt; i++)
+    {
+      struct kmem_cache *c = &caches[i];
+      size_t per_page = malloc_blocks_per_page (c->obj_size);
+      size_t pages;
+
+      lock_acquire (&c->lock);
+      pages = (per_page > 0
+               ? DIV_ROUND_UP (c->in_use_peak, per_page)
+               : c->in_use_peak * DIV_ROUND_UP (c->obj_size, PGSIZE));
+      printf ("  %-12s %zu/%zu, %zu, %llu, %zu/%zu, %zu/%zu, %zu\n",
+              c->name, c->obj_size, c->slot_size, c->obj_cnt, c->allocs,
+              c->in_use, c->in_use_peak, c->slab_cnt, c->slab_peak, pages);
+      slab_pages += c->slab_peak;
+      malloc_pages += pages;
+      lock_release (&c->lock);
+    }
+  printf ("Slab: %zu pages at peak, against %zu with malloc\n",
+          slab_pages, malloc_pages);
+}
+
+/* Creates a slab for cache C, which must be locked, and
+   constructs its objects.  Returns the new slab, or a null
+   pointer if memory is not available. */
+static struct slab *
+slab_create (struct kmem_cache *c)
+{
+  struct slab *s = palloc_get_page (0);
+  size_t i;
+
+  if (s == NULL)
+    return NULL;
+
+  s->magic = SLAB_MAGIC;
+  s->cache = c;
+  s->free_cnt = c->obj_cnt;
+  for (i = 0; i < c->obj_cnt; i++)
+    {
+      /* Hand out lower objects first. */
+      s->free[i] = c->obj_cnt - 1 - i;
+      if (c->ctor != NULL)
+        c->ctor (slab_obj (c, s, i));
+    }
+
+  if (++c->slab_cnt > c->slab_peak)
+    c->slab_peak = c->slab_cnt;
+  return s;
+}
+
+/* Destroys slab S, which must have no objects in use, in cache C,
+   which must be locked. */
+static void
+slab_destroy (struct kmem_cache *c, struct slab *s)
+{
+  size_t i;
+
+  ASSERT (s->free_cnt == c->obj_cnt);
+
+  if (c->dtor != NULL)
+    for (i = 0; i < c->obj_cnt; i++)
+      c->dtor (slab_obj (c, s, i));
+  s->magic = 0;
+  palloc_free_page (s);
+  c->slab_cnt--;
+}
+
+/* Returns object IDX in slab S of cache C. */
+static void *
+slab_obj (struct kmem_cache *c, struct slab *s, size_t idx)
+{
+  ASSERT (idx < c->obj_cnt);
+  return (uint8_t *) s + c->obj_ofs + idx * c->slot_size;
+}
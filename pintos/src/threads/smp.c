@@ -0,0 +1,414 @@
+#include "threads/smp.h"
+#include <debug.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/lapic.h"
+#include "devices/timer.h"
+#include "threads/fpu.h"
+#include "threads/init.h"
+#include "threads/interrupt.h"
+#include "threads/loader.h"
+#include "threads/palloc.h"
+#include "threads/pte.h"
+#include "threads/spinlock.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#ifdef USERPROG
+#include "userprog/gdt.h"
+#include "userprog/tss.h"
+#endif
+
+/* Symmetric multiprocessing.
+
+   The bootstrap processor (BSP) finds the other CPUs, the
+   application processors (APs), in the MultiProcessor
+   Specification configuration table that the BIOS leaves in low
+   memory, and boots each of them through its local APIC.  An AP
+   then runs its own idle thread and schedules threads from its
+   own run queue (see thread.c).
+
+   Kernel code assumes that turning interrupts off gives it
+   exclusive access to shared data, as it does on a single CPU.
+   That assumption is kept true across CPUs by the interrupt
+   lock, which a CPU holds whenever its interrupts are off (see
+   threads/interrupt.c).
+
+   Refer to [MP] for the configuration table and the AP startup
+   protocol. */
+
+/* Per-CPU data. */
+struct cpu cpus[CPU_MAX];
+
+/* Number of CPUs in cpus[], including any that failed to
+   start. */
+int cpu_cnt = 1;
+
+/* True once more than one CPU may be running.  Until then,
+   cpu_current() is always the BSP and the interrupt lock is not
+   used. */
+bool smp_active;
+
+/* MP floating pointer structure.  See [MP] 4.1. */
+struct mp_float
+  {
+    char signature[4];          /* "_MP_". */
+    uint32_t config;            /* Physical address of config table. */
+    uint8_t length;             /* Length in 16-byte units. */
+    uint8_t revision;           /* Specification revision. */
+    uint8_t checksum;           /* Makes all bytes sum to 0. */
+    uint8_t type;               /* Default configuration, or 0. */
+    uint8_t features[4];        /* Feature bytes 2...5. */
+  };
+
+/* MP configuration table header.  See [MP] 4.2. */
+struct mp_config
+  {
+    char signature[4];          /* "PCMP". */
+    uint16_t length;            /* Length including header, in bytes. */
+    uint8_t revision;           /* Specification revision. */
+    uint8_t checksum;           /* Makes all bytes sum to 0. */
+    char oem_id[8];             /* OEM name. */
+    char product_id[12];        /* Product name. */
+    uint32_t oem_table;         /* Physical address of OEM table. */
+    uint16_t oem_length;        /* Length of OEM table. */
+    uint16_t entry_cnt;         /* Number of entries that follow. */
+    uint32_t lapic_addr;        /* Physical address of local APICs. */
+    uint16_t ext_length;        /* Length of extended entries. */
+    uint8_t ext_checksum;       /* Checksum of extended entries. */
+    uint8_t reserved;
+  };
+
+/* MP configuration table processor entry.  See [MP] 4.3.1.
+   Entries of every other type are 8 bytes long. */
+struct mp_processor
+  {
+    uint8_t type;               /* MP_PROCESSOR. */
+    uint8_t apic_id;            /* Local APIC ID. */
+    uint8_t apic_version;       /* Local APIC version. */
+    uint8_t flags;              /* MPP_* flags. */
+    uint32_t signature;         /* CPU stepping, model, family. */
+    uint32_t features;          /* CPUID feature flags. */
+    uint32_t reserved[2];
+  };
+
+#define MP_PROCESSOR 0          /* Processor entry type. */
+#define MPP_ENABLED 0x01        /* Processor is usable. */
+#define MPP_BSP 0x02            /* Processor is the BSP. */
+
+/* AP startup code and its parameters, in ap-start.S. */
+extern uint8_t ap_start[], ap_start_end[];
+extern uint32_t ap_start_cr3, ap_start_esp;
+extern uint8_t ap_start_gdtr[6];
+
+static uint32_t mp_find_cpus (uint8_t apic_ids[], int *ap_cnt);
+static void *ap_start_param (void *param);
+static intr_handler_func lapic_timer_interrupt;
+static intr_handler_func reschedule_interrupt;
+static intr_handler_func tlb_interrupt;
+static intr_handler_func spurious_interrupt;
+void ap_main (void) NO_RETURN;
+
+/* Boots the application processors, if there are any.  Must be
+   called by the BSP with interrupts on, after the timer has
+   been calibrated and before any process starts. */
+void
+smp_init (void)
+{
+  uint8_t apic_ids[CPU_MAX];
+  uint32_t lapic_paddr;
+  uint32_t *boot_pd;
+  bool all_started = true;
+  int ap_cnt, started_cnt, i;
+
+  ASSERT (intr_get_level () == INTR_ON);
+  ASSERT (!smp_active);
+
+  lapic_paddr = mp_find_cpus (apic_ids, &ap_cnt);
+  if (lapic_paddr == 0 || ap_cnt == 0)
+    return;
+
+  lapic_init (lapic_paddr);
+  cpus[0].apic_id = lapic_id ();
+  lapic_timer_calibrate ();
+  intr_register_ext (LAPIC_VEC_TIMER, lapic_timer_interrupt, "APIC Timer");
+  intr_register_ext (LAPIC_VEC_RESCHEDULE, reschedule_interrupt,
+                     "Reschedule IPI");
+  intr_register_ext (LAPIC_VEC_TLB, tlb_interrupt, "TLB Shootdown IPI");
+  intr_register_int (LAPIC_VEC_SPURIOUS, 0, INTR_OFF, spurious_interrupt,
+                     "Spurious APIC Interrupt");
+
+  /* Copy the startup code to low memory.  It runs on a copy of
+     the kernel page directory that also maps the first 4 MB of
+     physical memory one-to-one, because it is running there when
+     it turns on paging. */
+  memcpy (ptov (AP_START_PADDR), ap_start, ap_start_end - ap_start);
+  boot_pd = palloc_get_page (PAL_ASSERT);
+  memcpy (boot_pd, init_page_dir, PGSIZE);
+  boot_pd[0] = init_page_dir[pd_no (PHYS_BASE)];
+  *(uint32_t *) ap_start_param (&ap_start_cr3) = vtop (boot_pd);
+  asm volatile ("sgdt %0" : "=m" (*(uint8_t (*)[6])
+                                  ap_start_param (ap_start_gdtr)));
+
+  cpus[0].started = true;
+  smp_active = true;
+  for (i = 0; i < ap_cnt; i++)
+    {
+      struct cpu *c = &cpus[cpu_cnt];
+      struct thread *idle;
+      int ms;
+
+      c->id = cpu_cnt;
+      c->apic_id = apic_ids[i];
+      idle = thread_create_idle (c);
+      if (idle == NULL)
+        break;
+      cpu_cnt++;
+
+      /* Start the AP on its idle thread's stack and give it a
+         second to come up. */
+      *(uint32_t *) ap_start_param (&ap_start_esp)
+        = (uint32_t) idle + PGSIZE;
+      lapic_start_ap (c->apic_id, AP_START_PADDR);
+      for (ms = 0; !c->started && ms < 1000; ms++)
+        timer_mdelay (1);
+      if (!c->started)
+        {
+          printf ("smp: cpu%d (APIC ID %d) failed to start\n",
+                  c->id, c->apic_id);
+          all_started = false;
+          break;
+        }
+    }
+
+  /* A CPU that did not start might still be running the startup
+     code, so only free its page directory if they all did. */
+  if (all_started)
+    palloc_free_page (boot_pd);
+
+  started_cnt = 1;
+  for (i = 1; i < cpu_cnt; i++)
+    if (cpus[i].started)
+      started_cnt++;
+  printf ("smp: %d CPUs online\n", started_cnt);
+}
+
+/* Entry point of an application processor, called by
+   ap-start.S on the stack of the AP's idle thread, with
+   interrupts off. */
+void
+ap_main (void)
+{
+  struct cpu *c = cpu_current ();
+
+  /* Leave the boot page directory. */
+  asm volatile ("movl %0, %%cr3" : : "r" (vtop (init_page_dir)) : "memory");
+  c->active_pd = init_page_dir;
+
+  intr_init_ap ();
+#ifdef USERPROG
+  tss_init ();
+  gdt_init_ap ();
+#endif
+  lapic_init_ap ();
+  fpu_init_ap ();
+
+  c->started = true;
+  thread_start_ap ();
+}
+
+/* Asks CPU C to reconsider which thread it should be running,
+   because a thread was just made ready on its run queue. */
+void
+smp_reschedule (struct cpu *c)
+{
+  ASSERT (smp_active);
+
+  if (c != cpu_current () && c->started)
+    lapic_send_ipi (c->apic_id, LAPIC_VEC_RESCHEDULE);
+}
+
+/* Makes sure that no CPU other than the running one has stale
+   TLB entries for page directory PD, whose entries the caller
+   has just changed.  (The caller takes care of the running
+   CPU.)  Waits for the other CPUs to flush.
+
+   The caller may hold the interrupt lock, so a CPU that is
+   waiting for the lock cannot take the IPI and flushes when it
+   sees tlb_flush_pending instead (see interrupt.c).  Likewise,
+   we keep polling our own flag while we wait, in case another
+   CPU is shooting down our TLB at the same time. */
+void
+smp_tlb_shootdown (uint32_t *pd)
+{
+  struct cpu *self;
+  int i;
+
+  if (!smp_active)
+    return;
+
+  /* The page table change must be visible to the other CPUs
+     before we look at which page directories they are using. */
+  asm volatile ("lock; addl $0, (%%esp)" : : : "memory");
+
+  self = cpu_current ();
+  for (i = 0; i < cpu_cnt; i++)
+    {
+      struct cpu *c = &cpus[i];
+      if (c != self && c->started && c->active_pd == pd)
+        {
+          c->tlb_flush_pending = true;
+          lapic_send_ipi (c->apic_id, LAPIC_VEC_TLB);
+        }
+    }
+
+  for (i = 0; i < cpu_cnt; i++)
+    if (&cpus[i] != self)
+      while (cpus[i].tlb_flush_pending)
+        {
+          smp_tlb_poll ();
+          cpu_relax ();
+        }
+}
+
+/* Flushes the running CPU's TLB if another CPU asked for it. */
+void
+smp_tlb_poll (void)
+{
+  struct cpu *c = cpu_current ();
+
+  if (c->tlb_flush_pending)
+    {
+      /* Reloading CR3 clears the TLB.  See [IA32-v3a] 3.12
+         "Translation Lookaside Buffers (TLBs)". */
+      uint32_t cr3;
+      asm volatile ("movl %%cr3, %0; movl %0, %%cr3"
+                    : "=r" (cr3) : : "memory");
+      c->tlb_flush_pending = false;
+    }
+}
+
+/* Returns the address in the low copy of the AP startup code
+   that corresponds to PARAM in the original. */
+static void *
+ap_start_param (void *param)
+{
+  return (uint8_t *) ptov (AP_START_PADDR) + ((uint8_t *) param - ap_start);
+}
+
+/* Returns the 8-bit sum of the SIZE bytes at P, which is 0 for
+   a valid MP structure. */
+static uint8_t
+checksum (const void *p_, size_t size)
+{
+  const uint8_t *p = p_;
+  uint8_t sum = 0;
+
+  while (size-- > 0)
+    sum += *p++;
+  return sum;
+}
+
+/* Looks for an MP floating pointer structure in the SIZE bytes
+   of physical memory at PADDR. */
+static struct mp_float *
+mp_search_range (uint32_t paddr, size_t size)
+{
+  uint8_t *p = ptov (paddr);
+  uint8_t *end = p + size;
+
+  for (; p + sizeof (struct mp_float) <= end; p += 16)
+    if (!memcmp (p, "_MP_", 4) && checksum (p, sizeof (struct mp_float)) == 0)
+      return (struct mp_float *) p;
+  return NULL;
+}
+
+/* Finds the MP floating pointer structure, which is in the
+   first kB of the extended BIOS data area, in the last kB of
+   base memory, or in the BIOS ROM.  See [MP] 4. */
+static struct mp_float *
+mp_search (void)
+{
+  const uint8_t *bda = ptov (0x400);
+  uint32_t ebda = (uint32_t) (bda[0x0f] << 8 | bda[0x0e]) << 4;
+  uint32_t base_kb = bda[0x14] << 8 | bda[0x13];
+  struct mp_float *mp = NULL;
+
+  if (ebda != 0)
+    mp = mp_search_range (ebda, 1024);
+  if (mp == NULL && base_kb != 0)
+    mp = mp_search_range ((base_kb - 1) * 1024, 1024);
+  if (mp == NULL)
+    mp = mp_search_range (0xf0000, 0x10000);
+  return mp;
+}
+
+/* Reads the local APIC IDs of the enabled application
+   processors, up to CPU_MAX - 1 of them, into APIC_IDS and
+   their number into *AP_CNT.  Returns the physical address of
+   the local APICs, or 0 if there is no usable MP configuration
+   table. */
+static uint32_t
+mp_find_cpus (uint8_t apic_ids[], int *ap_cnt)
+{
+  struct mp_float *mp = mp_search ();
+  struct mp_config *config;
+  uint8_t *p, *end;
+  int i;
+
+  *ap_cnt = 0;
+  if (mp == NULL || mp->config == 0 || mp->type != 0)
+    return 0;
+  if (mp->config + sizeof *config > init_ram_pages * PGSIZE)
+    return 0;
+  config = ptov (mp->config);
+  if (memcmp (config->signature, "PCMP", 4)
+      || mp->config + config->length > init_ram_pages * PGSIZE
+      || checksum (config, config->length) != 0)
+    return 0;
+
+  p = (uint8_t *) (config + 1);
+  end = (uint8_t *) config + config->length;
+  for (i = 0; i < config->entry_cnt && p < end; i++)
+    if (*p == MP_PROCESSOR)
+      {
+        struct mp_processor *proc = (struct mp_processor *) p;
+        if ((proc->flags & MPP_ENABLED) && !(proc->flags & MPP_BSP)
+            && *ap_cnt < CPU_MAX - 1)
+          apic_ids[(*ap_cnt)++] = proc->apic_id;
+        p += sizeof *proc;
+      }
+    else
+      p += 8;
+  return config->lapic_addr;
+}
+
+/* Local APIC timer interrupt handler.  Only application
+   processors run their local APIC timers; the BSP's ticks come
+   from the PIT (see devices/timer.c). */
+static void
+lapic_timer_interrupt (struct intr_frame *args UNUSED)
+{
+  thread_tick ();
+}
+
+/* Reschedule IPI handler. */
+static void
+reschedule_interrupt (struct intr_frame *args UNUSED)
+{
+  thread_preempt ();
+}
+
+/* TLB shootdown IPI handler.  Runs without the interrupt lock
+   (see intr_handler()). */
+static void
+tlb_interrupt (struct intr_frame *args UNUSED)
+{
+  smp_tlb_poll ();
+}
+
+/* Spurious local APIC interrupt handler.  A spurious interrupt
+   must not be acknowledged. */
+static void
+spurious_interrupt (struct intr_frame *args UNUSED)
+{
+}
@@ -0,0 +1,61 @@
+#ifndef THREADS_SMP_H
+#define THREADS_SMP_H
+
+/* Maximum number of CPUs. */
+#define CPU_MAX 8
+
+/* Physical address that application processors start executing
+   at.  Must be page-aligned and below 1 MB. */
+#define AP_START_PADDR 0x8000
+
+#ifndef __ASSEMBLER__
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Per-CPU data.
+
+   The bootstrap processor (BSP) is always cpus[0].  Each CPU
+   always runs on the stack of some thread, and that thread's
+   `cpu' member says which CPU it is, so cpu_current() is
+   cheap. */
+struct cpu
+  {
+    int id;                     /* Index into cpus[]. */
+    uint8_t apic_id;            /* Local APIC ID. */
+    volatile bool started;      /* Booted and scheduling? */
+    struct thread *idle_thread; /* Runs when nothing else is ready. */
+    struct thread *running;     /* Thread now running on this CPU. */
+    unsigned thread_ticks;      /* # of timer ticks since last yield. */
+    bool need_resched;          /* Yield once preemption is enabled? */
+
+    /* Owned by threads/interrupt.c. */
+    bool in_external_intr;      /* Processing an external interrupt? */
+    bool yield_on_return;       /* Yield on interrupt return? */
+    uint64_t irqsoff_start;     /* TSC when interrupts went off, or 0. */
+    void *irqsoff_caller;       /* Where they were turned off. */
+
+    /* Statistics, owned by threads/thread.c. */
+    long long idle_ticks;       /* # of timer ticks spent idle. */
+    long long kernel_ticks;     /* # of timer ticks in kernel threads. */
+    long long user_ticks;       /* # of timer ticks in user programs. */
+
+    /* Owned by threads/fpu.c. */
+    struct thread *fpu_owner;   /* Thread whose state is in the FPU. */
+
+    /* TLB shootdown, owned by threads/smp.c. */
+    uint32_t *active_pd;        /* Page directory loaded in CR3. */
+    volatile bool tlb_flush_pending;    /* CR3 must be reloaded. */
+  };
+
+extern struct cpu cpus[CPU_MAX];
+extern int cpu_cnt;
+extern bool smp_active;
+
+void smp_init (void);
+struct cpu *cpu_current (void);
+void smp_reschedule (struct cpu *);
+void smp_tlb_shootdown (uint32_t *pd);
+void smp_tlb_poll (void);
+#endif
+
+#endif /* threads/smp.h */
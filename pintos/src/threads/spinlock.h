@@ -0,0 +1,71 @@
+#ifndef THREADS_SPINLOCK_H
+#define THREADS_SPINLOCK_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Spin lock.
+
+   A spin lock provides mutual exclusion between CPUs by busy
+   waiting, so it may only be held across short stretches of
+   code that never sleep.  Acquiring one does nothing about
+   interrupts on the local CPU.  Most kernel code never uses a
+   spin lock directly: intr_disable() takes the one that the
+   rest of Pintos relies on (see threads/interrupt.c). */
+struct spinlock
+  {
+    volatile uint32_t locked;   /* 1 while held, 0 otherwise. */
+  };
+
+/* Atomically stores VALUE into *P and returns the old value.
+   XCHG with a memory operand is implicitly locked and is a full
+   memory barrier.  See [IA32-v2b] "XCHG". */
+static inline uint32_t
+atomic_xchg (volatile uint32_t *p, uint32_t value)
+{
+  asm volatile ("xchgl %0, %1" : "+r" (value), "+m" (*p) : : "memory");
+  return value;
+}
+
+/* Tells the CPU that it is in a spin-wait loop.
+   See [IA32-v2b] "PAUSE". */
+static inline void
+cpu_relax (void)
+{
+  asm volatile ("pause" : : : "memory");
+}
+
+/* Initializes LOCK as unheld. */
+static inline void
+spinlock_init (struct spinlock *lock)
+{
+  lock->locked = 0;
+}
+
+/* Tries to acquire LOCK without spinning and returns true if
+   successful. */
+static inline bool
+spinlock_try_acquire (struct spinlock *lock)
+{
+  return atomic_xchg (&lock->locked, 1) == 0;
+}
+
+/* Acquires LOCK, spinning until it is available.  Spins on a
+   plain read between attempts so that waiting CPUs do not keep
+   the lock's cache line bouncing between them. */
+static inline void
+spinlock_acquire (struct spinlock *lock)
+{
+  while (!spinlock_try_acquire (lock))
+    while (lock->locked)
+      cpu_relax ();
+}
+
+/* Releases LOCK, which the caller must hold. */
+static inline void
+spinlock_release (struct spinlock *lock)
+{
+  atomic_xchg (&lock->locked, 0);
+}
+
+#endif /* threads/spinlock.h */
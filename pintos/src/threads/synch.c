@@ -30,8 +30,14 @@
 #include <stdio.h>
 #include <string.h>
 #include "threads/interrupt.h"
+#include "threads/io.h"
+#include "threads/lockstat.h"
 #include "threads/thread.h"
 
+static heap_less_func thread_priority_less;
+static void wait_on (struct heap *, struct thread *donee);
+static struct thread *wake_one (struct heap *);
+
 /* Initializes semaphore SEMA to VALUE.  A semaphore is a
    nonnegative integer along with two atomic operators for
    manipulating it:
@@ -47,7 +53,20 @@ sema_init (struct semaphore *sema, unsigned value)
   ASSERT (sema != NULL);
 
   sema->value = value;
-  list_init (&sema->waiters);
+  heap_init (&sema->waiters, thread_priority_less, NULL);
+  sema->stat = NULL;
+}
+
+/* Initializes SEMA to VALUE, like sema_init(), and profiles
+   sema_down() on it as part of the class NAME if lock profiling
+   is enabled.  Worth doing for semaphores used for mutual
+   exclusion or to wait for devices; NAME must remain valid
+   until shutdown. */
+void
+sema_init_named (struct semaphore *sema, unsigned value, const char *name)
+{
+  sema_init (sema, value);
+  sema->stat = lockstat_register (name);
 }
 
 /* Down or "P" operation on a semaphore.  Waits for SEMA's value
@@ -66,11 +85,17 @@ sema_down (struct semaphore *sema)
   ASSERT (!intr_context ());
 
   old_level = intr_disable ();
-  while (sema->value == 0)
+  if (sema->stat != NULL)
     {
-      list_push_back (&sema->waiters, &thread_current ()->elem);
-      thread_block ();
+      bool contended = sema->value == 0;
+      uint64_t start = rdtsc ();
+      while (sema->value == 0)
+        wait_on (&sema->waiters, NULL);
+      lockstat_acquired (sema->stat, contended, rdtsc () - start);
     }
+  else
+    while (sema->value == 0)
+      wait_on (&sema->waiters, NULL);
   sema->value--;
   intr_set_level (old_level);
 }
@@ -102,7 +127,9 @@ sema_try_down (struct semaphore *sema)
 }
 
 /* Up or "V" operation on a semaphore.  Increments SEMA's value
-   and wakes up one thread of those waiting for SEMA, if any.
+   and wakes up the highest-priority thread of those waiting for
+   SEMA, if any, breaking ties in FIFO order.  Yields if the
+   woken thread has a higher priority than the running thread.
 
    This function may be called from an interrupt handler. */
 void
@@ -113,11 +140,12 @@ sema_up (struct semaphore *sema)
   ASSERT (sema != NULL);
 
   old_level = intr_disable ();
-  if (!list_empty (&sema->waiters))
-    thread_unblock (list_entry (list_pop_front (&sema->waiters),
-                                struct thread, elem));
+  if (!heap_empty (&sema->waiters))
+    wake_one (&sema->waiters);
   sema->value++;
   intr_set_level (old_level);
+  if (old_level == INTR_ON || intr_context ())
+    thread_preempt ();
 }
 
 static void sema_test_helper (void *sema_);
@@ -171,20 +199,46 @@ sema_test_helper (void *sema_)
    another one "up" it, but with a lock the same thread must both
    acquire and release it.  When these restrictions prove
    onerous, it's a good sign that a semaphore should be used,
-   instead of a lock. */
+   instead of a lock.
+
+   Most code calls this function through the lock_init() macro,
+   which names the lock after the expression that points to it,
+   for lock profiling.  NAME must remain valid until shutdown. */
 void
-lock_init (struct lock *lock)
+lock_init_named (struct lock *lock, const char *name)
 {
   ASSERT (lock != NULL);
 
   lock->holder = NULL;
-  sema_init (&lock->semaphore, 1);
+  sema_init_named (&lock->semaphore, 1, name);
+}
+
+/* Makes the current thread, which has just acquired LOCK, its
+   holder.  The threads still waiting for LOCK now donate their
+   priority to the current thread instead of the previous
+   holder. */
+static void
+lock_take (struct lock *lock)
+{
+  struct thread *cur = thread_current ();
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (lock->semaphore.stat != NULL)
+    lock->acquired = rdtsc ();
+  lock->holder = cur;
+  list_push_back (&cur->held_locks, &lock->elem);
+  thread_update_priority (cur);
 }
 
 /* Acquires LOCK, sleeping until it becomes available if
    necessary.  The lock must not already be held by the current
    thread.
 
+   While waiting, the current thread donates its priority to the
+   lock's holder, and through it to whatever that holder is
+   waiting on in turn.  The MLFQS does not use donation.
+
    This function may sleep, so it must not be called within an
    interrupt handler.  This function may be called with
    interrupts disabled, but interrupts will be turned back on if
@@ -192,12 +246,32 @@ lock_init (struct lock *lock)
 void
 lock_acquire (struct lock *lock)
 {
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+
   ASSERT (lock != NULL);
   ASSERT (!intr_context ());
   ASSERT (!lock_held_by_current_thread (lock));
 
-  sema_down (&lock->semaphore);
-  lock->holder = thread_current ();
+  /* Like sema_down(), but donating to the holder while we
+     wait. */
+  old_level = intr_disable ();
+  cur->waiting_lock = lock;
+  if (lock->semaphore.stat != NULL)
+    {
+      bool contended = lock->semaphore.value == 0;
+      uint64_t start = rdtsc ();
+      while (lock->semaphore.value == 0)
+        wait_on (&lock->semaphore.waiters, lock->holder);
+      lockstat_acquired (lock->semaphore.stat, contended, rdtsc () - start);
+    }
+  else
+    while (lock->semaphore.value == 0)
+      wait_on (&lock->semaphore.waiters, lock->holder);
+  lock->semaphore.value--;
+  cur->waiting_lock = NULL;
+  lock_take (lock);
+  intr_set_level (old_level);
 }
 
 /* Tries to acquires LOCK and returns true if successful or false
@@ -209,18 +283,28 @@ lock_acquire (struct lock *lock)
 bool
 lock_try_acquire (struct lock *lock)
 {
+  enum intr_level old_level;
   bool success;
 
   ASSERT (lock != NULL);
   ASSERT (!lock_held_by_current_thread (lock));
 
+  old_level = intr_disable ();
   success = sema_try_down (&lock->semaphore);
   if (success)
-    lock->holder = thread_current ();
+    {
+      if (lock->semaphore.stat != NULL)
+        lockstat_acquired (lock->semaphore.stat, false, 0);
+      lock_take (lock);
+    }
+  intr_set_level (old_level);
   return success;
 }
 
 /* Releases LOCK, which must be owned by the current thread.
+   Drops the donations made by threads waiting for LOCK and
+   recomputes the current thread's priority from those that
+   remain, yielding if it is no longer the highest.
 
    An interrupt handler cannot acquire a lock, so it does not
    make sense to try to release a lock within an interrupt
@@ -228,11 +312,23 @@ lock_try_acquire (struct lock *lock)
 void
 lock_release (struct lock *lock)
 {
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+
   ASSERT (lock != NULL);
   ASSERT (lock_held_by_current_thread (lock));
 
+  old_level = intr_disable ();
+  if (lock->semaphore.stat != NULL)
+    lockstat_released (lock->semaphore.stat, rdtsc () - lock->acquired);
+  list_remove (&lock->elem);
+  thread_update_priority (cur);
+
   lock->holder = NULL;
   sema_up (&lock->semaphore);
+  intr_set_level (old_level);
+  if (old_level == INTR_ON)
+    thread_preempt ();
 }
 
 /* Returns true if the current thread holds LOCK, false
@@ -246,13 +342,6 @@ lock_held_by_current_thread (const struct lock *lock)
   return lock->holder == thread_current ();
 }
 
-/* One semaphore in a list. */
-struct semaphore_elem
-  {
-    struct list_elem elem;              /* List element. */
-    struct semaphore semaphore;         /* This semaphore. */
-  };
-
 /* Initializes condition variable COND.  A condition variable
    allows one piece of code to signal a condition and cooperating
    code to receive the signal and act upon it. */
@@ -261,7 +350,7 @@ cond_init (struct condition *cond)
 {
   ASSERT (cond != NULL);
 
-  list_init (&cond->waiters);
+  heap_init (&cond->waiters, thread_priority_less, NULL);
 }
 
 /* Atomically releases LOCK and waits for COND to be signaled by
@@ -287,23 +376,26 @@ cond_init (struct condition *cond)
 void
 cond_wait (struct condition *cond, struct lock *lock)
 {
-  struct semaphore_elem waiter;
+  enum intr_level old_level;
 
   ASSERT (cond != NULL);
   ASSERT (lock != NULL);
   ASSERT (!intr_context ());
   ASSERT (lock_held_by_current_thread (lock));
 
-  sema_init (&waiter.semaphore, 0);
-  list_push_back (&cond->waiters, &waiter.elem);
+  /* With interrupts off, no signal can come between releasing
+     LOCK and starting to wait. */
+  old_level = intr_disable ();
   lock_release (lock);
-  sema_down (&waiter.semaphore);
+  wait_on (&cond->waiters, NULL);
+  intr_set_level (old_level);
   lock_acquire (lock);
 }
 
 /* If any threads are waiting on COND (protected by LOCK), then
-   this function signals one of them to wake up from its wait.
-   LOCK must be held before calling this function.
+   this function signals the highest-priority one of them to
+   wake up from its wait.  LOCK must be held before calling this
+   function.
 
    An interrupt handler cannot acquire a lock, so it does not
    make sense to try to signal a condition variable within an
@@ -311,14 +403,19 @@ cond_wait (struct condition *cond, struct lock *lock)
 void
 cond_signal (struct condition *cond, struct lock *lock UNUSED)
 {
+  enum intr_level old_level;
+
   ASSERT (cond != NULL);
   ASSERT (lock != NULL);
   ASSERT (!intr_context ());
   ASSERT (lock_held_by_current_thread (lock));
 
-  if (!list_empty (&cond->waiters))
-    sema_up (&list_entry (list_pop_front (&cond->waiters),
-                          struct semaphore_elem, elem)->semaphore);
+  old_level = intr_disable ();
+  if (!heap_empty (&cond->waiters))
+    wake_one (&cond->waiters);
+  intr_set_level (old_level);
+  if (old_level == INTR_ON)
+    thread_preempt ();
 }
 
 /* Wakes up all threads, if any, waiting on COND (protected by
@@ -333,6 +430,255 @@ cond_broadcast (struct condition *cond, struct lock *lock)
   ASSERT (cond != NULL);
   ASSERT (lock != NULL);
 
-  while (!list_empty (&cond->waiters))
+  while (!heap_empty (&cond->waiters))
     cond_signal (cond, lock);
 }
+
+/* Initializes readers-writer lock RW.  Any number of threads
+   may hold a readers-writer lock at once for reading ("shared"),
+   or a single thread may hold it for writing ("exclusive"), but
+   not both.  Like a lock, it is not recursive.
+
+   Waiting writers are preferred over arriving readers, so that
+   a steady stream of readers cannot starve a writer: once a
+   writer is waiting, a new reader waits too unless its priority
+   is higher than every waiting writer's.  When the lock becomes
+   free, it is handed to the highest-priority waiting writer, or,
+   if a waiting reader has a higher priority still, to all of
+   the waiting readers whose priority is higher than any waiting
+   writer's.  Readers-writer locks do not take part in priority
+   donation. */
+void
+rwlock_init (struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+
+  rw->readers = 0;
+  rw->writer = NULL;
+  heap_init (&rw->read_waiters, thread_priority_less, NULL);
+  heap_init (&rw->write_waiters, thread_priority_less, NULL);
+}
+
+/* Returns the highest priority of the threads in WAITERS, or -1
+   if WAITERS is empty. */
+static int
+max_waiter_priority (struct heap *waiters)
+{
+  if (heap_empty (waiters))
+    return -1;
+  return heap_entry (heap_max (waiters), struct thread, wait_elem)->priority;
+}
+
+/* Returns true if a thread with the given PRIORITY may acquire
+   RW for reading right away. */
+static bool
+rwlock_may_read (struct rwlock *rw, int priority)
+{
+  return (rw->writer == NULL
+          && priority > max_waiter_priority (&rw->write_waiters));
+}
+
+/* Hands RW, which has just become free, to the waiting threads
+   that should get it next, as described at rwlock_init(), and
+   wakes them up.  Does not preempt. */
+static void
+rwlock_grant (struct rwlock *rw)
+{
+  int writer_priority = max_waiter_priority (&rw->write_waiters);
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (rw->writer == NULL && rw->readers == 0);
+
+  if (writer_priority >= 0
+      && writer_priority >= max_waiter_priority (&rw->read_waiters))
+    {
+      rw->writer = wake_one (&rw->write_waiters);
+      return;
+    }
+
+  while (max_waiter_priority (&rw->read_waiters) > writer_priority)
+    {
+      rw->readers++;
+      wake_one (&rw->read_waiters);
+    }
+}
+
+/* Acquires RW for reading, sleeping until that is possible if
+   necessary.  The current thread must not already hold RW.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+void
+rwlock_acquire_read (struct rwlock *rw)
+{
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+
+  ASSERT (rw != NULL);
+  ASSERT (!intr_context ());
+  ASSERT (!rwlock_held_by_current_thread (rw));
+
+  old_level = intr_disable ();
+  if (rwlock_may_read (rw, cur->priority))
+    rw->readers++;
+  else
+    {
+      /* rwlock_grant() counts us as a reader before waking us. */
+      wait_on (&rw->read_waiters, NULL);
+    }
+  intr_set_level (old_level);
+}
+
+/* Tries to acquire RW for reading without sleeping and returns
+   true if successful, false on failure. */
+bool
+rwlock_try_acquire_read (struct rwlock *rw)
+{
+  enum intr_level old_level;
+  bool success;
+
+  ASSERT (rw != NULL);
+
+  old_level = intr_disable ();
+  success = rwlock_may_read (rw, thread_current ()->priority);
+  if (success)
+    rw->readers++;
+  intr_set_level (old_level);
+  return success;
+}
+
+/* Releases RW, which the current thread holds for reading. */
+void
+rwlock_release_read (struct rwlock *rw)
+{
+  enum intr_level old_level;
+
+  ASSERT (rw != NULL);
+
+  old_level = intr_disable ();
+  ASSERT (rw->writer == NULL && rw->readers > 0);
+  if (--rw->readers == 0)
+    rwlock_grant (rw);
+  intr_set_level (old_level);
+  if (old_level == INTR_ON)
+    thread_preempt ();
+}
+
+/* Acquires RW for writing, sleeping until that is possible if
+   necessary.  The current thread must not already hold RW.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+void
+rwlock_acquire_write (struct rwlock *rw)
+{
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+
+  ASSERT (rw != NULL);
+  ASSERT (!intr_context ());
+  ASSERT (!rwlock_held_by_current_thread (rw));
+
+  old_level = intr_disable ();
+  if (rw->writer == NULL && rw->readers == 0)
+    rw->writer = cur;
+  else
+    {
+      /* rwlock_grant() makes us the writer before waking us. */
+      wait_on (&rw->write_waiters, NULL);
+    }
+  ASSERT (rw->writer == cur);
+  intr_set_level (old_level);
+}
+
+/* Tries to acquire RW for writing without sleeping and returns
+   true if successful, false on failure. */
+bool
+rwlock_try_acquire_write (struct rwlock *rw)
+{
+  enum intr_level old_level;
+  bool success;
+
+  ASSERT (rw != NULL);
+
+  old_level = intr_disable ();
+  success = rw->writer == NULL && rw->readers == 0;
+  if (success)
+    rw->writer = thread_current ();
+  intr_set_level (old_level);
+  return success;
+}
+
+/* Releases RW, which the current thread holds for writing. */
+void
+rwlock_release_write (struct rwlock *rw)
+{
+  enum intr_level old_level;
+
+  ASSERT (rw != NULL);
+  ASSERT (rwlock_held_by_current_thread (rw));
+
+  old_level = intr_disable ();
+  rw->writer = NULL;
+  rwlock_grant (rw);
+  intr_set_level (old_level);
+  if (old_level == INTR_ON)
+    thread_preempt ();
+}
+
+/* Returns true if the current thread holds RW for writing, false
+   otherwise.  (Which threads hold it for reading is not
+   tracked.) */
+bool
+rwlock_held_by_current_thread (const struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+
+  return rw->writer == thread_current ();
+}
+
+/* Adds the current thread to wait queue QUEUE and blocks it
+   until wake_one() wakes it.  If DONEE is nonnull, it holds the
+   lock whose waiters QUEUE holds, so the current thread's
+   priority is donated to it while it waits.  Interrupts must be
+   off. */
+static void
+wait_on (struct heap *queue, struct thread *donee)
+{
+  struct thread *cur = thread_current ();
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  heap_push (queue, &cur->wait_elem);
+  cur->wait_queue = queue;
+  if (donee != NULL)
+    thread_update_priority (donee);
+  thread_block ();
+}
+
+/* Wakes up and returns the highest-priority thread in wait
+   queue QUEUE, the one that has waited longest of those with
+   that priority.  QUEUE must not be empty.  Does not preempt.
+   Interrupts must be off. */
+static struct thread *
+wake_one (struct heap *queue)
+{
+  struct thread *t;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  t = heap_entry (heap_pop_max (queue), struct thread, wait_elem);
+  t->wait_queue = NULL;
+  thread_unblock (t);
+  return t;
+}
+
+/* Returns true if the thread in wait queue element A has lower
+   priority than the one in B. */
+static bool
+thread_priority_less (const struct heap_elem *a, const struct heap_elem *b,
+                      void *aux UNUSED)
+{
+  return heap_entry (a, struct thread, wait_elem)->priority
+         < heap_entry (b, struct thread, wait_elem)->priority;
+}
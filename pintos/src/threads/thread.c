@@ -1,16 +1,23 @@
 #include "threads/thread.h"
+#include <bitmap.h>
 #include <debug.h>
 #include <stddef.h>
 #include <random.h>
+#include <round.h>
 #include <stdio.h>
 #include <string.h>
 #include "threads/flags.h"
+#include "threads/fpu.h"
 #include "threads/interrupt.h"
 #include "threads/intr-stubs.h"
 #include "threads/palloc.h"
+#include "threads/smp.h"
+#include "threads/spinlock.h"
 #include "threads/switch.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
+#include "threads/workqueue.h"
+#include "devices/timer.h"
 #ifdef USERPROG
 #include "userprog/process.h"
 #endif
@@ -20,21 +27,47 @@
    of thread.h for details. */
 #define THREAD_MAGIC 0xcd6abf4b
 
-/* List of processes in THREAD_READY state, that is, processes
-   that are ready to run but not actually running. */
-static struct list ready_list;
+/* Run queue: processes in THREAD_READY state, that is,
+   processes that are ready to run but not actually running.
+   There is one FIFO list per CPU group and priority level, and
+   bit P of `mask[G]' is set exactly when queues[G][P] is
+   nonempty, so the highest ready priority in a group is found
+   with a bit scan instead of a walk over every ready thread.
+   Bit G of `groups' is set exactly when mask[G] is nonzero.
+
+   Each CPU has its own run queue, in run_queues[] at the CPU's
+   index.  A ready thread is on the run queue of the CPU that its
+   `cpu' member names.  A CPU whose own run queue is empty steals
+   from the others before going idle. */
+struct run_queue
+  {
+    struct list queues[GROUP_CNT][PRI_MAX + 1]; /* FIFOs. */
+    uint64_t mask[GROUP_CNT];           /* Nonempty queues, by group. */
+    uint32_t groups;                    /* Groups with nonempty queues. */
+    int count;                          /* Number of threads. */
+  };
+static struct run_queue run_queues[CPU_MAX];
 
 /* List of all processes.  Processes are added to this list
    when they are first scheduled and removed when they exit. */
 static struct list all_list;
 
-/* Idle thread. */
-static struct thread *idle_thread;
-
 /* Initial thread, the thread running init.c:main(). */
 static struct thread *initial_thread;
 
-/* Lock used by allocate_tid(). */
+/* Threads by tid, for thread_by_tid().  Threads are added by
+   init_thread() and removed by thread_exit(), except that the
+   initial thread is added by thread_start(), because the table
+   cannot be allocated before malloc() is initialized. */
+static struct hash tid_table;
+
+/* Tids in use.  allocate_tid() hands out the lowest free tid, so
+   tids are reused once their threads exit. */
+#define TID_CNT 16384                   /* Number of tids. */
+static struct bitmap *tid_map;
+static uint32_t tid_map_buf[TID_CNT / 32 + 4];
+
+/* Lock for tid_table and tid_map. */
 static struct lock tid_lock;
 
 /* Stack frame for kernel_thread(). */
@@ -45,31 +78,198 @@ struct kernel_thread_frame
     void *aux;                  /* Auxiliary data for function. */
   };
 
-/* Statistics. */
-static long long idle_ticks;    /* # of timer ticks spent idle. */
-static long long kernel_ticks;  /* # of timer ticks in kernel threads. */
-static long long user_ticks;    /* # of timer ticks in user programs. */
-
 /* Scheduling. */
 #define TIME_SLICE 4            /* # of timer ticks to give each thread. */
-static unsigned thread_ticks;   /* # of timer ticks since last yield. */
+#define DONATION_DEPTH 8        /* Max length of a followed donation chain. */
 
 /* If false (default), use round-robin scheduler.
    If true, use multi-level feedback queue scheduler.
    Controlled by kernel command-line option "-o mlfqs". */
 bool thread_mlfqs;
 
+/* See thread.h. */
+bool thread_zero_stacks;
+
+/* See thread.h.  Statistics of threads that have exited are
+   summed into exited_schedstat. */
+bool thread_schedstat;
+static struct schedstat exited_schedstat;
+static int exited_cnt;
+
+/* Pages of threads that have died, kept for reuse by new
+   threads so that creating a thread does not have to search the
+   page allocator's bitmap or zero a whole page.  Bounded so that
+   a burst of threads does not keep memory from the rest of the
+   kernel.  Protected by disabling interrupts. */
+#define THREAD_CACHE_SIZE 16
+static void *thread_cache[THREAD_CACHE_SIZE];
+static size_t thread_cache_cnt;
+static long long thread_cache_hits;   /* # of pages taken from cache. */
+static long long thread_cache_misses; /* # of pages from palloc. */
+
+/* Multi-level feedback queue scheduler.
+
+   The 4.4BSD scheduler decays every thread's recent_cpu once per
+   second.  Doing that eagerly would walk all threads inside the
+   timer interrupt, so instead the decay coefficient of each
+   second is logged in decay_log[] and a thread's recent_cpu is
+   brought up to date (mlfqs_sync()) only when it is next looked
+   at.  After each second, the timer interrupt also queues
+   mlfqs_sweep() on wq_high, which walks all_list with a cursor
+   and syncs every thread, a few at a time with interrupts
+   turned back on in between, so that a ready thread's priority
+   reflects the decay soon after each second passes.
+
+   Priorities are recomputed only for threads whose inputs
+   changed: the running thread every 4 ticks, a thread whose
+   nice value is set, and the threads visited by the sweep or
+   woken up. */
+#define MLFQS_PRI_TICKS 4       /* Recompute running thread's priority. */
+#define DECAY_LOG_SIZE 64       /* Seconds of decay coefficients kept. */
+#define SWEEP_BATCH 8           /* Threads synced per interrupt-off run. */
+static fixed_point_t load_avg;  /* System load average. */
+static unsigned mlfqs_epoch;    /* Seconds of decay applied so far. */
+static fixed_point_t decay_log[DECAY_LOG_SIZE]; /* By epoch mod SIZE. */
+static struct list_elem *sweep_cursor;  /* Next thread in all_list to sync. */
+static struct work sweep_work;  /* Runs mlfqs_sweep(). */
+static int ready_count;         /* # of threads in all run queues. */
+
+/* Real-time class.
+
+   A thread enters the class with thread_set_rt(), declaring that
+   in every PERIOD ticks it needs RUNTIME ticks of CPU by
+   DEADLINE ticks after the period starts.  Each period is a job,
+   which the thread ends by calling thread_rt_yield().
+
+   Ready real-time threads wait in rt_queue, ordered by the
+   absolute deadline of their current job, and every CPU runs
+   the one with the earliest deadline ahead of any thread in the
+   priority run queues.  While in the class a thread's priority
+   is PRI_MAX, so that priority donation still works when it
+   waits on a lock held by an ordinary thread.
+
+   thread_tick() charges the running real-time thread's budget.
+   A thread that runs out of budget, or ends its job, is blocked
+   ("throttled") until its next period starts, when rt_tick()
+   refills its budget and sets its next deadline.  A job that
+   has not ended by its deadline counts as a deadline miss in the
+   thread's schedstat.
+
+   Admission control keeps the sum of RUNTIME / DEADLINE over
+   all real-time threads, in units of 1/RT_UNIT, within
+   RT_LIMIT per CPU, which leaves ordinary threads some CPU time
+   and, on one CPU, guarantees that every deadline is met. */
+#define RT_UNIT 1000            /* Density of a thread that never rests. */
+#define RT_LIMIT 950            /* Real-time density allowed per CPU. */
+static struct heap rt_queue;    /* Ready RT threads, earliest deadline first. */
+static struct list rt_list;     /* All RT threads. */
+static int rt_density;          /* Sum of admitted densities. */
+
+/* CPU groups.
+
+   Every thread belongs to one of GROUP_CNT groups, group 0 by
+   default.  A new thread starts out in its creator's group, so
+   a user process and the processes it starts share a group
+   unless one of them moves with thread_set_group().  A user
+   process, through its system calls, may only move to a group
+   that no other thread is in and that restricts it at least as
+   much (thread_restrict_group()), and may only tighten the
+   limits of its own group (thread_group_tighten()), so that a
+   tenant cannot loosen its limits or use up another's share.
+
+   The scheduler is fair between groups first, and goes by
+   priority within a group.  Each group has a weight and a
+   virtual run time, which thread_tick() advances by
+   GROUP_VRUNTIME_SCALE / weight for every tick that one of the
+   group's threads runs, so a group with twice the weight
+   advances half as fast.  A CPU runs a thread from the group
+   with the least virtual run time among those in its run
+   queue, and a thread woken in another group preempts only if
+   its group is more than a tick behind.  A group that had no
+   ready threads catches up to min_vruntime when one wakes, so
+   that sleeping does not bank CPU time.
+
+   A group may also have a cap, in percent of one CPU.  Once its
+   threads have run for their quota of ticks in the current
+   GROUP_PERIOD-tick period, the group is throttled: its ready
+   threads are passed over and its running threads yield, until
+   group_tick() starts the next period.  Group 0, which holds
+   the kernel's own threads, cannot be capped.
+
+   With every thread in group 0, as by default, scheduling is
+   just as without groups.  Groups live in a statically
+   initialized array so that they can be configured from the
+   kernel command line, before thread_init(). */
+#define GROUP_PERIOD 20                 /* Ticks per quota period. */
+#define GROUP_VRUNTIME_SCALE (1 << 20)  /* Virtual run time per tick... */
+#define GROUP_WAKEUP_GRAN (GROUP_VRUNTIME_SCALE / GROUP_WEIGHT_DEFAULT)
+
+struct thread_group
+  {
+    int weight;                 /* Share of the CPU. */
+    int cap;                    /* Percent of a CPU, or 0 if uncapped. */
+    int quota;                  /* Ticks per period, or 0 if uncapped. */
+    int used;                   /* Ticks run this period. */
+    int64_t period_end;         /* Tick at which the period ends. */
+    uint64_t vruntime;          /* Virtual run time. */
+    int ready_cnt;              /* Threads in run queues. */
+    bool throttled;             /* Out of quota until period_end? */
+    long long ticks;            /* Ticks run in total. */
+    long long throttle_cnt;     /* Number of times throttled. */
+  };
+static struct thread_group groups[GROUP_CNT] =
+  {
+    [0 ... GROUP_CNT - 1] = { .weight = GROUP_WEIGHT_DEFAULT },
+  };
+static uint64_t min_vruntime;   /* Virtual run time of last group run. */
+
 static void kernel_thread (thread_func *, void *aux);
 
-static void idle (void *aux UNUSED);
+static void idle (void *aux) NO_RETURN;
 static struct thread *running_thread (void);
 static struct thread *next_thread_to_run (void);
-static void init_thread (struct thread *, const char *name, int priority);
+static void init_thread (struct thread *, const char *name, int priority,
+                         tid_t);
 static bool is_thread (struct thread *) UNUSED;
 static void *alloc_frame (struct thread *, size_t size);
+static struct thread *alloc_thread_page (void);
+static void free_thread_page (struct thread *);
+static void ready_queue_push (struct thread *);
+static void ready_queue_remove (struct thread *);
+static int ready_queue_group (struct run_queue *);
+static int ready_queue_max_priority (struct run_queue *, int group);
+static struct thread *ready_queue_peek (struct run_queue *);
+static struct thread *ready_queue_pop (struct run_queue *);
+static struct cpu *select_cpu (struct thread *);
+static bool thread_precedes (const struct thread *, const struct thread *);
+static bool rt_preempts (struct thread *);
+static heap_less_func rt_deadline_less;
+static int rt_density_of (int runtime, int deadline);
+static void rt_tick (int64_t now);
+static void rt_release (struct thread *, int64_t now);
+static void rt_leave (struct thread *);
+static bool group_precedes (const struct thread_group *,
+                            const struct thread_group *);
+static bool group_charge (struct thread_group *);
+static void group_tick (int64_t now);
+static void group_unthrottle (int group);
+static bool group_restricts (int weight, int cap,
+                             const struct thread_group *);
+static bool group_in_use (int group, const struct thread *except);
 static void schedule (void);
 void thread_schedule_tail (struct thread *prev);
 static tid_t allocate_tid (void);
+static void free_tid (tid_t);
+static hash_hash_func tid_hash;
+static hash_less_func tid_less;
+static void mlfqs_tick (struct thread *);
+static void mlfqs_sync (struct thread *);
+static void mlfqs_update_priority (struct thread *);
+static work_func mlfqs_sweep;
+static void schedstat_add (struct schedstat *, const struct schedstat *);
+static void schedstat_print (const char *name, tid_t,
+                             const struct schedstat *);
+static void schedstat_print_thread (struct thread *, void *aux);
 
 /* Initializes the threading system by transforming the code
    that's currently running into a thread.  This can't work in
@@ -87,29 +287,61 @@ static tid_t allocate_tid (void);
 void
 thread_init (void)
 {
+  int i;
+
   ASSERT (intr_get_level () == INTR_OFF);
 
   lock_init (&tid_lock);
-  list_init (&ready_list);
+  ASSERT (bitmap_buf_size (TID_CNT) <= sizeof tid_map_buf);
+  tid_map = bitmap_create_in_buf (TID_CNT, tid_map_buf, sizeof tid_map_buf);
+  bitmap_mark (tid_map, 0);
+  for (i = 0; i < CPU_MAX; i++)
+    {
+      struct run_queue *rq = &run_queues[i];
+      int group, pri;
+
+      for (group = 0; group < GROUP_CNT; group++)
+        {
+          for (pri = PRI_MIN; pri <= PRI_MAX; pri++)
+            list_init (&rq->queues[group][pri]);
+          rq->mask[group] = 0;
+        }
+      rq->groups = 0;
+      rq->count = 0;
+    }
   list_init (&all_list);
+  heap_init (&rt_queue, rt_deadline_less, NULL);
+  list_init (&rt_list);
 
   /* Set up a thread structure for the running thread. */
   initial_thread = running_thread ();
-  init_thread (initial_thread, "main", PRI_DEFAULT);
+  init_thread (initial_thread, "main", PRI_DEFAULT, TID_ERROR);
   initial_thread->status = THREAD_RUNNING;
+  cpus[0].running = initial_thread;
   initial_thread->tid = allocate_tid ();
 }
 
 /* Starts preemptive thread scheduling by enabling interrupts.
-   Also creates the idle thread. */
+   Also creates the idle thread and the tid table, so malloc()
+   must be initialized first. */
 void
 thread_start (void)
 {
-  /* Create the idle thread. */
   struct semaphore idle_started;
+
+  /* Create the tid table. */
+  hash_init (&tid_table, tid_hash, tid_less, NULL);
+  hash_insert (&tid_table, &initial_thread->tidelem);
+
+  /* Create the idle thread. */
   sema_init (&idle_started, 0);
   thread_create ("idle", PRI_MIN, idle, &idle_started);
 
+  /* Create the workqueues, whose workers will have run and
+     blocked by the time the idle thread does. */
+  workqueue_init_system ();
+  work_init (&sweep_work, mlfqs_sweep, NULL);
+
   /* Start preemptive thread scheduling. */
   intr_enable ();
 
@@ -117,34 +349,148 @@ thread_start (void)
   sema_down (&idle_started);
 }
 
+/* Creates the idle thread for application processor CPU, which
+   will start out running on that thread's stack (see
+   threads/smp.c).  Returns the new thread, or a null pointer if
+   memory allocation fails. */
+struct thread *
+thread_create_idle (struct cpu *cpu)
+{
+  struct thread *t;
+  char name[16];
+  tid_t tid;
+
+  t = alloc_thread_page ();
+  if (t == NULL)
+    return NULL;
+  tid = allocate_tid ();
+  if (tid == TID_ERROR)
+    {
+      free_thread_page (t);
+      return NULL;
+    }
+
+  snprintf (name, sizeof name, "idle%d", cpu->id);
+  init_thread (t, name, PRI_MIN, tid);
+  t->status = THREAD_RUNNING;
+  t->cpu = cpu;
+  cpu->idle_thread = cpu->running = t;
+  return t;
+}
+
+/* Starts scheduling threads on the application processor that
+   calls this function, which must be running its idle thread
+   with interrupts off. */
+void
+thread_start_ap (void)
+{
+  idle (NULL);
+}
+
 /* Called by the timer interrupt handler at each timer tick.
-   Thus, this function runs in an external interrupt context. */
+   Thus, this function runs in an external interrupt context,
+   except that ticks skipped while the idle thread ran tickless
+   are charged to it with interrupts off from the idle loop. */
 void
 thread_tick (void)
 {
   struct thread *t = thread_current ();
+  struct cpu *cpu = t->cpu;
 
   /* Update statistics. */
-  if (t == idle_thread)
-    idle_ticks++;
+  if (t == cpu->idle_thread)
+    cpu->idle_ticks++;
 #ifdef USERPROG
   else if (t->pagedir != NULL)
-    user_ticks++;
+    {
+      cpu->user_ticks++;
+      t->schedstat.user_ticks++;
+    }
 #endif
   else
-    kernel_ticks++;
+    {
+      cpu->kernel_ticks++;
+      t->schedstat.kernel_ticks++;
+    }
 
-  /* Enforce preemption. */
-  if (++thread_ticks >= TIME_SLICE)
-    intr_yield_on_return ();
+  if (thread_mlfqs)
+    mlfqs_tick (t);
+  if (cpu->id == 0 && !list_empty (&rt_list))
+    rt_tick (timer_ticks ());
+  if (cpu->id == 0)
+    group_tick (timer_ticks ());
+
+  /* Enforce preemption.  The idle thread gives up the CPU on its
+     own as soon as anything is ready, and may be charged ticks
+     outside interrupt context after a tickless idle period.  A
+     real-time thread has no time slice; it runs until its budget
+     is spent or a thread with an earlier deadline is ready.
+     Other threads also yield as soon as their group is
+     throttled. */
+  if (t == cpu->idle_thread)
+    return;
+  if (t->rt_runtime > 0)
+    {
+      if (--t->rt_budget <= 0 || rt_preempts (t))
+        intr_yield_on_return ();
+    }
+  else
+    {
+      bool throttled = group_charge (&groups[t->group]);
+      if (throttled || ++cpu->thread_ticks >= TIME_SLICE
+          || rt_preempts (t))
+        intr_yield_on_return ();
+    }
 }
 
-/* Prints thread statistics. */
+/* Prints thread statistics, in total and, if more than one CPU
+   ran, for each CPU. */
 void
 thread_print_stats (void)
 {
+  long long idle_ticks = 0, kernel_ticks = 0, user_ticks = 0;
+  int i;
+
+  for (i = 0; i < cpu_cnt; i++)
+    {
+      idle_ticks += cpus[i].idle_ticks;
+      kernel_ticks += cpus[i].kernel_ticks;
+      user_ticks += cpus[i].user_ticks;
+    }
   printf ("Thread: %lld idle ticks, %lld kernel ticks, %lld user ticks\n",
           idle_ticks, kernel_ticks, user_ticks);
+  if (cpu_cnt > 1)
+    for (i = 0; i < cpu_cnt; i++)
+      printf ("  cpu%d: %lld idle ticks, %lld kernel ticks, "
+              "%lld user ticks\n", i, cpus[i].idle_ticks,
+              cpus[i].kernel_ticks, cpus[i].user_ticks);
+  printf ("Thread cache: %lld hits, %lld misses\n",
+          thread_cache_hits, thread_cache_misses);
+  for (i = 1; i < GROUP_CNT; i++)
+    if (groups[i].ticks > 0)
+      break;
+  if (i < GROUP_CNT)
+    for (i = 0; i < GROUP_CNT; i++)
+      if (groups[i].ticks > 0)
+        printf ("Group %d: weight %d, cap %d%%, %lld ticks, "
+                "throttled %lld times\n", i, groups[i].weight,
+                groups[i].cap, groups[i].ticks, groups[i].throttle_cnt);
+
+  if (thread_schedstat)
+    {
+      enum intr_level old_level = intr_disable ();
+      printf ("Schedstat: ticks user/kernel/ready/max-ready, "
+              "switches vol/invol, deadline misses, "
+              "wakeup latency histogram\n");
+      thread_foreach (schedstat_print_thread, NULL);
+      if (exited_cnt > 0)
+        {
+          char name[32];
+          snprintf (name, sizeof name, "(%d exited)", exited_cnt);
+          schedstat_print (name, TID_ERROR, &exited_schedstat);
+        }
+      intr_set_level (old_level);
+    }
 }
 
 /* Creates a new kernel thread named NAME with the given initial
@@ -159,9 +505,8 @@ thread_print_stats (void)
    scheduled.  Use a semaphore or some other form of
    synchronization if you need to ensure ordering.
 
-   The code provided sets the new thread's `priority' member to
-   PRIORITY, but no actual priority scheduling is implemented.
-   Priority scheduling is the goal of Problem 1-3. */
+   If the new thread has a higher priority than the running
+   thread, the running thread yields to it immediately. */
 tid_t
 thread_create (const char *name, int priority,
                thread_func *function, void *aux)
@@ -175,13 +520,18 @@ thread_create (const char *name, int priority,
   ASSERT (function != NULL);
 
   /* Allocate thread. */
-  t = palloc_get_page (PAL_ZERO);
+  t = alloc_thread_page ();
   if (t == NULL)
     return TID_ERROR;
+  tid = allocate_tid ();
+  if (tid == TID_ERROR)
+    {
+      free_thread_page (t);
+      return TID_ERROR;
+    }
 
   /* Initialize thread. */
-  init_thread (t, name, priority);
-  tid = t->tid = allocate_tid ();
+  init_thread (t, name, priority, tid);
 
   /* Stack frame for kernel_thread(). */
   kf = alloc_frame (t, sizeof *kf);
@@ -215,6 +565,7 @@ thread_block (void)
 {
   ASSERT (!intr_context ());
   ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (thread_current ()->preempt_count == 0);
 
   thread_current ()->status = THREAD_BLOCKED;
   schedule ();
@@ -224,21 +575,50 @@ thread_block (void)
    This is an error if T is not blocked.  (Use thread_yield() to
    make the running thread ready.)
 
-   This function does not preempt the running thread.  This can
-   be important: if the caller had disabled interrupts itself,
-   it may expect that it can atomically unblock a thread and
-   update other data. */
+   If T has a higher priority than the running thread, the
+   running thread is preempted, but only when that cannot break
+   the caller's atomicity: if the caller had disabled interrupts
+   itself, it may expect that it can atomically unblock a thread
+   and update other data, so in that case preemption is left to
+   the caller (see thread_preempt()).  Within an interrupt
+   handler, the yield happens on return from the interrupt.
+
+   T may be queued on another CPU instead (see select_cpu()),
+   which is then asked to reschedule if T should preempt what it
+   is running. */
 void
 thread_unblock (struct thread *t)
 {
   enum intr_level old_level;
+  struct cpu *cpu;
 
   ASSERT (is_thread (t));
 
   old_level = intr_disable ();
   ASSERT (t->status == THREAD_BLOCKED);
-  list_push_back (&ready_list, &t->elem);
+  if (t->rt_runtime > 0 && t->rt_budget <= 0)
+    {
+      /* Out of budget: stay blocked until the next period. */
+      t->rt_throttled = true;
+      intr_set_level (old_level);
+      return;
+    }
+  if (thread_mlfqs)
+    mlfqs_update_priority (t);
+  cpu = select_cpu (t);
+  t->cpu = cpu;
+  ready_queue_push (t);
   t->status = THREAD_READY;
+  t->ready_since = timer_ticks ();
+  t->woken = true;
+  if (cpu != cpu_current ())
+    {
+      if (cpu->running == cpu->idle_thread
+          || thread_precedes (t, cpu->running))
+        smp_reschedule (cpu);
+    }
+  else if (old_level == INTR_ON || intr_context ())
+    thread_preempt ();
   intr_set_level (old_level);
 }
 
@@ -275,6 +655,265 @@ thread_tid (void)
   return thread_current ()->tid;
 }
 
+/* Returns the running or not yet exited thread whose tid is
+   TID, or a null pointer if there is none.  Nothing keeps the
+   thread from exiting after this function returns, so the
+   caller must know by other means that it is still alive before
+   using the pointer for anything more than a comparison.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+struct thread *
+thread_by_tid (tid_t tid)
+{
+  struct thread key;
+  struct hash_elem *e;
+
+  key.tid = tid;
+  lock_acquire (&tid_lock);
+  e = hash_find (&tid_table, &key.tidelem);
+  lock_release (&tid_lock);
+
+  return e != NULL ? hash_entry (e, struct thread, tidelem) : NULL;
+}
+
+/* Copies the scheduling statistics of the thread whose tid is
+   TID into *ST and returns true, or returns false if there is no
+   such thread.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+bool
+thread_get_schedstat (tid_t tid, struct schedstat *st)
+{
+  struct thread key;
+  struct hash_elem *e;
+  enum intr_level old_level;
+
+  /* Holding tid_lock keeps the thread from exiting. */
+  key.tid = tid;
+  lock_acquire (&tid_lock);
+  e = hash_find (&tid_table, &key.tidelem);
+  if (e != NULL)
+    {
+      old_level = intr_disable ();
+      *st = hash_entry (e, struct thread, tidelem)->schedstat;
+      intr_set_level (old_level);
+    }
+  lock_release (&tid_lock);
+
+  return e != NULL;
+}
+
+/* Puts the running thread in the real-time class, replacing its
+   parameters if it is already there: in every PERIOD ticks, it
+   is to get RUNTIME ticks of CPU by DEADLINE ticks after the
+   period starts, where 0 < RUNTIME <= DEADLINE <= PERIOD.  Its
+   first period starts now.  Returns false, changing nothing, if
+   the parameters are invalid or admitting the thread would
+   overload the CPUs.
+
+   A RUNTIME of 0 takes the running thread out of the class,
+   which always succeeds. */
+bool
+thread_set_rt (int runtime, int period, int deadline)
+{
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+  int density, old_density;
+
+  if (runtime == 0)
+    {
+      old_level = intr_disable ();
+      if (cur->rt_runtime > 0)
+        rt_leave (cur);
+      intr_set_level (old_level);
+      thread_preempt ();
+      return true;
+    }
+  if (runtime < 0 || deadline < runtime || period < deadline)
+    return false;
+
+  density = rt_density_of (runtime, deadline);
+  old_level = intr_disable ();
+  old_density = (cur->rt_runtime > 0
+                 ? rt_density_of (cur->rt_runtime, cur->rt_deadline) : 0);
+  if (rt_density - old_density + density > RT_LIMIT * cpu_cnt)
+    {
+      intr_set_level (old_level);
+      return false;
+    }
+  if (cur->rt_runtime > 0)
+    rt_leave (cur);
+  rt_density += density;
+  cur->rt_runtime = runtime;
+  cur->rt_period = period;
+  cur->rt_deadline = deadline;
+  list_push_back (&rt_list, &cur->rtelem);
+  rt_release (cur, timer_ticks ());
+  thread_update_priority (cur);
+  intr_set_level (old_level);
+
+  thread_preempt ();
+  return true;
+}
+
+/* Ends the running real-time thread's current job, and blocks
+   it until its next period starts.  For a thread that is not
+   real-time, the same as thread_yield(). */
+void
+thread_rt_yield (void)
+{
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+
+  ASSERT (!intr_context ());
+
+  if (cur->rt_runtime == 0)
+    {
+      thread_yield ();
+      return;
+    }
+
+  old_level = intr_disable ();
+  if (!cur->rt_missed && timer_ticks () >= cur->rt_abs_deadline)
+    {
+      cur->rt_missed = true;
+      cur->schedstat.deadline_misses++;
+    }
+  cur->rt_done = true;
+  cur->rt_throttled = true;
+  thread_block ();
+  intr_set_level (old_level);
+}
+
+/* Returns the tick at which a thread throttled by the real-time
+   class, or by its group's cap, may next run, or INT64_MAX if
+   none is throttled.  The idle thread keeps the timer ticking
+   until then. */
+int64_t
+thread_next_release (void)
+{
+  int64_t release = INT64_MAX;
+  struct list_elem *e;
+  int i;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  for (e = list_begin (&rt_list); e != list_end (&rt_list);
+       e = list_next (e))
+    {
+      struct thread *t = list_entry (e, struct thread, rtelem);
+      if (t->rt_throttled && t->rt_next_release < release)
+        release = t->rt_next_release;
+    }
+  for (i = 1; i < GROUP_CNT; i++)
+    if (groups[i].throttled && groups[i].period_end < release)
+      release = groups[i].period_end;
+  return release;
+}
+
+/* Sets the weight of CPU group GROUP to WEIGHT and its cap to
+   CAP percent of one CPU, or removes its cap if CAP is 0.
+   Returns false, changing nothing, if an argument is out of
+   range or CAP is nonzero for group 0.  May be called before
+   thread_init(). */
+bool
+thread_group_config (int group, int weight, int cap)
+{
+  struct thread_group *g;
+  enum intr_level old_level;
+
+  if (group < 0 || group >= GROUP_CNT
+      || weight < GROUP_WEIGHT_MIN || weight > GROUP_WEIGHT_MAX
+      || cap < 0 || cap > 100 * CPU_MAX || (group == 0 && cap != 0))
+    return false;
+
+  old_level = intr_disable ();
+  g = &groups[group];
+  g->weight = weight;
+  g->cap = cap;
+  g->quota = DIV_ROUND_UP (cap * GROUP_PERIOD, 100);
+  if (g->throttled && (g->quota == 0 || g->used < g->quota))
+    group_unthrottle (group);
+  intr_set_level (old_level);
+  return true;
+}
+
+/* Moves the running thread to CPU group GROUP.  Threads it
+   creates from now on start out in the same group.  Returns
+   false if GROUP is out of range. */
+bool
+thread_set_group (int group)
+{
+  enum intr_level old_level;
+
+  if (group < 0 || group >= GROUP_CNT)
+    return false;
+
+  old_level = intr_disable ();
+  thread_current ()->group = group;
+  intr_set_level (old_level);
+  thread_preempt ();
+  return true;
+}
+
+/* Like thread_set_group(), but only lets the running thread move
+   to a group that no other thread is in, and that restricts it
+   at least as much as its current one: no more weight, and a
+   cap no larger, so that a capped thread cannot escape to an
+   uncapped group.  Returns false, changing nothing, otherwise.
+   For user processes, which may neither lift their own limits
+   nor share another tenant's group. */
+bool
+thread_restrict_group (int group)
+{
+  struct thread *cur = thread_current ();
+  const struct thread_group *to;
+  enum intr_level old_level;
+  bool ok;
+
+  if (group < 0 || group >= GROUP_CNT)
+    return false;
+
+  old_level = intr_disable ();
+  to = &groups[group];
+  ok = (group == cur->group
+        || (group_restricts (to->weight, to->cap, &groups[cur->group])
+            && !group_in_use (group, cur)));
+  if (ok)
+    cur->group = group;
+  intr_set_level (old_level);
+  if (ok)
+    thread_preempt ();
+  return ok;
+}
+
+/* Like thread_group_config(), but only for the running thread's
+   own group, other than group 0, and only to lower its weight or
+   to cap it or lower its cap.  Returns false, changing nothing,
+   otherwise.  For user processes, which may tighten their own
+   limits but not loosen them. */
+bool
+thread_group_tighten (int group, int weight, int cap)
+{
+  enum intr_level old_level;
+  bool ok;
+
+  old_level = intr_disable ();
+  ok = (group == thread_current ()->group && group != 0
+        && group_restricts (weight, cap, &groups[group]));
+  intr_set_level (old_level);
+  return ok && thread_group_config (group, weight, cap);
+}
+
+/* Returns the running thread's CPU group. */
+int
+thread_get_group (void)
+{
+  return thread_current ()->group;
+}
+
 /* Deschedules the current thread and destroys it.  Never
    returns to the caller. */
 void
@@ -286,10 +925,24 @@ thread_exit (void)
   process_exit ();
 #endif
 
+  fpu_thread_exit (thread_current ());
+
+  /* Give up our tid. */
+  lock_acquire (&tid_lock);
+  hash_delete (&tid_table, &thread_current ()->tidelem);
+  free_tid (thread_current ()->tid);
+  lock_release (&tid_lock);
+
   /* Remove thread from all threads list, set our status to dying,
      and schedule another process.  That process will destroy us
      when it calls thread_schedule_tail(). */
   intr_disable ();
+  if (thread_current ()->rt_runtime > 0)
+    rt_leave (thread_current ());
+  schedstat_add (&exited_schedstat, &thread_current ()->schedstat);
+  exited_cnt++;
+  if (sweep_cursor == &thread_current ()->allelem)
+    sweep_cursor = list_next (sweep_cursor);
   list_remove (&thread_current()->allelem);
   thread_current ()->status = THREAD_DYING;
   schedule ();
@@ -307,13 +960,109 @@ thread_yield (void)
   ASSERT (!intr_context ());
 
   old_level = intr_disable ();
-  if (cur != idle_thread)
-    list_push_back (&ready_list, &cur->elem);
-  cur->status = THREAD_READY;
+  if (cur->rt_runtime > 0 && cur->rt_budget <= 0)
+    {
+      /* Out of budget: wait for the next period. */
+      cur->rt_throttled = true;
+      cur->status = THREAD_BLOCKED;
+    }
+  else
+    {
+      if (cur != cur->cpu->idle_thread)
+        ready_queue_push (cur);
+      cur->status = THREAD_READY;
+      cur->ready_since = timer_ticks ();
+      cur->woken = false;
+    }
   schedule ();
   intr_set_level (old_level);
 }
 
+/* Yields the CPU if a ready thread should run rather than the
+   running thread (see thread_precedes()).  Within an external
+   interrupt handler, arranges for the yield to happen on return
+   from the interrupt instead, and if the running thread has
+   disabled preemption, once it may be preempted. */
+void
+thread_preempt (void)
+{
+  enum intr_level old_level = intr_disable ();
+  struct thread *cur = running_thread ();
+  struct cpu *cpu = cur->cpu;
+  struct thread *next;
+
+  if (cur != cpu->idle_thread
+      && (rt_preempts (cur)
+          || (cur->rt_runtime == 0
+              && (next = ready_queue_peek (&run_queues[cpu->id])) != NULL
+              && thread_precedes (next, cur))))
+    {
+      if (intr_context ())
+        intr_yield_on_return ();
+      else if (cur->preempt_count == 0)
+        thread_yield ();
+      else
+        cpu->need_resched = true;
+    }
+  intr_set_level (old_level);
+}
+
+/* Kernel preemption.
+
+   Kernel code is preempted whenever an interrupt returns with a
+   thread to yield to, unless interrupts were off.  Between
+   preempt_disable() and preempt_enable(), which nest, the
+   running thread is not preempted, although interrupts are
+   still handled: a yield that falls due is recorded in the
+   CPU's `need_resched' and happens at preempt_enable().  A
+   preemption-disabled region may not sleep.
+
+   Long-running kernel loops, such as zeroing a new file's
+   sectors or scanning a large bitmap, call cond_resched() every
+   so often, which takes a pending yield at once.  Like Linux's,
+   it does nothing within such a region, so that code relying on
+   preempt_disable(), like malloc()'s per-CPU magazines, stays
+   protected even if it calls one of those loops. */
+
+/* Disables preemption of the running thread. */
+void
+preempt_disable (void)
+{
+  thread_current ()->preempt_count++;
+  barrier ();
+}
+
+/* Reenables preemption of the running thread, yielding if a
+   yield fell due while it was disabled. */
+void
+preempt_enable (void)
+{
+  struct thread *cur = thread_current ();
+
+  barrier ();
+  ASSERT (cur->preempt_count > 0);
+  if (--cur->preempt_count == 0 && cur->cpu->need_resched
+      && intr_get_level () == INTR_ON)
+    thread_yield ();
+}
+
+/* Yields the CPU if a yield fell due while the running thread
+   had preemption disabled.  Does nothing with interrupts off,
+   so it may be called from code that sometimes runs in an
+   interrupt handler or during boot, or with preemption still
+   disabled. */
+void
+cond_resched (void)
+{
+  struct thread *cur;
+
+  if (intr_get_level () == INTR_OFF)
+    return;
+  cur = thread_current ();
+  if (cur->preempt_count == 0 && cur->cpu->need_resched)
+    thread_yield ();
+}
+
 /* Invoke function 'func' on all threads, passing along 'aux'.
    This function must be called with interrupts off. */
 void
@@ -331,86 +1080,325 @@ thread_foreach (thread_action_func *func, void *aux)
     }
 }
 
-/* Sets the current thread's priority to NEW_PRIORITY. */
+/* Sets the current thread's base priority to NEW_PRIORITY.
+   Donations it has received still apply on top of it.  Yields
+   if that leaves a ready thread with higher priority.  Ignored
+   under the MLFQS, which computes priorities itself. */
 void
 thread_set_priority (int new_priority)
 {
-  thread_current ()->priority = new_priority;
+  enum intr_level old_level;
+
+  ASSERT (PRI_MIN <= new_priority && new_priority <= PRI_MAX);
+
+  if (thread_mlfqs)
+    return;
+
+  old_level = intr_disable ();
+  thread_current ()->base_priority = new_priority;
+  thread_update_priority (thread_current ());
+  intr_set_level (old_level);
+  thread_preempt ();
 }
 
-/* Returns the current thread's priority. */
+/* Recomputes T's effective priority as the maximum of its base
+   priority, or PRI_MAX for a real-time thread, and the
+   priorities of the threads donating to it, that is, of the
+   highest-priority waiter of each lock it holds.
+   Then propagates the change down the chain of lock holders T
+   is waiting on, so that nested donation works.  The walk stops
+   as soon as a priority does not change, or after
+   DONATION_DEPTH links.  The MLFQS does not use donation.
+
+   A ready thread whose priority changes is moved to the run
+   queue of its new priority, and a blocked one to its new place
+   in the queue it waits on.  Does not preempt; callers do that
+   when it is safe to. */
+void
+thread_update_priority (struct thread *t)
+{
+  enum intr_level old_level = intr_disable ();
+  int depth;
+
+  for (depth = 0; t != NULL && depth < DONATION_DEPTH; depth++)
+    {
+      int priority = t->rt_runtime > 0 ? PRI_MAX : t->base_priority;
+      struct list_elem *e;
+
+      ASSERT (is_thread (t));
+
+      for (e = list_begin (&t->held_locks);
+           e != list_end (&t->held_locks) && !thread_mlfqs;
+           e = list_next (e))
+        {
+          struct heap *waiters = &list_entry (e, struct lock,
+                                              elem)->semaphore.waiters;
+          if (!heap_empty (waiters))
+            {
+              struct thread *donor = heap_entry (heap_max (waiters),
+                                                 struct thread, wait_elem);
+              if (donor->priority > priority)
+                priority = donor->priority;
+            }
+        }
+      if (priority == t->priority)
+        break;
+
+      if (t->status == THREAD_READY)
+        {
+          ready_queue_remove (t);
+          t->priority = priority;
+          ready_queue_push (t);
+        }
+      else
+        {
+          t->priority = priority;
+          if (t->wait_queue != NULL)
+            heap_update (t->wait_queue, &t->wait_elem);
+        }
+
+      t = t->waiting_lock != NULL ? t->waiting_lock->holder : NULL;
+    }
+  intr_set_level (old_level);
+}
+
+/* Returns the current thread's effective priority. */
 int
 thread_get_priority (void)
 {
   return thread_current ()->priority;
 }
 
-/* Sets the current thread's nice value to NICE. */
+/* Sets the current thread's nice value to NICE, clamped to
+   NICE_MIN...NICE_MAX, and recomputes its priority.  Yields if
+   it no longer has the highest priority. */
 void
-thread_set_nice (int nice UNUSED)
+thread_set_nice (int nice)
 {
-  /* Not yet implemented. */
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+
+  if (nice < NICE_MIN)
+    nice = NICE_MIN;
+  else if (nice > NICE_MAX)
+    nice = NICE_MAX;
+
+  old_level = intr_disable ();
+  mlfqs_sync (cur);
+  cur->nice = nice;
+  if (thread_mlfqs)
+    mlfqs_update_priority (cur);
+  intr_set_level (old_level);
+  thread_preempt ();
 }
 
 /* Returns the current thread's nice value. */
 int
 thread_get_nice (void)
 {
-  /* Not yet implemented. */
-  return 0;
+  return thread_current ()->nice;
 }
 
 /* Returns 100 times the system load average. */
 int
 thread_get_load_avg (void)
 {
-  /* Not yet implemented. */
-  return 0;
+  enum intr_level old_level = intr_disable ();
+  int load_avg_100 = fix_round (fix_scale (load_avg, 100));
+  intr_set_level (old_level);
+  return load_avg_100;
 }
 
 /* Returns 100 times the current thread's recent_cpu value. */
 int
 thread_get_recent_cpu (void)
 {
-  /* Not yet implemented. */
-  return 0;
+  struct thread *cur = thread_current ();
+  enum intr_level old_level = intr_disable ();
+  int recent_cpu_100;
+
+  mlfqs_sync (cur);
+  recent_cpu_100 = fix_round (fix_scale (cur->recent_cpu, 100));
+  intr_set_level (old_level);
+  return recent_cpu_100;
+}
+
+/* MLFQS work done at every timer tick on behalf of T, the
+   running thread.  Charges T for the tick, closes out a second
+   when one has passed, and recomputes the priorities whose
+   inputs changed.  Takes constant time regardless of the number
+   of threads.
+
+   Every CPU charges its own running thread, but only the BSP,
+   whose ticks drive timer_ticks(), does the system-wide work. */
+static void
+mlfqs_tick (struct thread *t)
+{
+  struct cpu *cpu = t->cpu;
+  int64_t now = timer_ticks ();
+  int i;
+
+  if (t != cpu->idle_thread)
+    {
+      mlfqs_sync (t);
+      t->recent_cpu = fix_add (t->recent_cpu, fix_int (1));
+    }
+
+  if (cpu->id == 0 && now % TIMER_FREQ == 0)
+    {
+      int ready_threads = ready_count;
+      fixed_point_t twice_load;
+
+      for (i = 0; i < cpu_cnt; i++)
+        if (cpus[i].running != cpus[i].idle_thread)
+          ready_threads++;
+
+      load_avg = fix_add (fix_mul (fix_frac (59, 60), load_avg),
+                          fix_unscale (fix_int (ready_threads), 60));
+      twice_load = fix_scale (load_avg, 2);
+      decay_log[mlfqs_epoch % DECAY_LOG_SIZE]
+        = fix_div (twice_load, fix_add (twice_load, fix_int (1)));
+      mlfqs_epoch++;
+      queue_work (&wq_high, &sweep_work);
+    }
+
+  if (t != cpu->idle_thread && now % MLFQS_PRI_TICKS == 0)
+    mlfqs_update_priority (t);
+  thread_preempt ();
+}
+
+/* Syncs the recent_cpu and recomputes the priority of every
+   thread that is not running.  Runs in a worker thread, queued
+   by mlfqs_tick() once a second.  Turns interrupts back on
+   every SWEEP_BATCH threads; thread_exit() keeps the cursor
+   valid meanwhile. */
+static void
+mlfqs_sweep (void *aux UNUSED)
+{
+  enum intr_level old_level = intr_disable ();
+  int i = 0;
+
+  for (sweep_cursor = list_begin (&all_list);
+       sweep_cursor != list_end (&all_list); )
+    {
+      struct thread *s = list_entry (sweep_cursor, struct thread, allelem);
+
+      sweep_cursor = list_next (sweep_cursor);
+      if (s != s->cpu->idle_thread && s->status != THREAD_RUNNING)
+        mlfqs_update_priority (s);
+      if (++i % SWEEP_BATCH == 0)
+        {
+          intr_set_level (old_level);
+          old_level = intr_disable ();
+        }
+    }
+  sweep_cursor = NULL;
+  intr_set_level (old_level);
+}
+
+/* Applies to T's recent_cpu the once-per-second decays that
+   have happened since it was last brought up to date:
+
+       recent_cpu = (2*load_avg)/(2*load_avg + 1) * recent_cpu + nice
+
+   Seconds older than DECAY_LOG_SIZE are no longer logged.  They
+   are applied with the oldest coefficient still logged,
+   stopping early once recent_cpu settles at the fixed point
+   the formula converges to. */
+static void
+mlfqs_sync (struct thread *t)
+{
+  unsigned epoch = t->recent_cpu_epoch;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (mlfqs_epoch - epoch > DECAY_LOG_SIZE)
+    {
+      fixed_point_t decay = decay_log[mlfqs_epoch % DECAY_LOG_SIZE];
+
+      for (; epoch != mlfqs_epoch - DECAY_LOG_SIZE; epoch++)
+        {
+          fixed_point_t old = t->recent_cpu;
+
+          t->recent_cpu = fix_add (fix_mul (decay, old),
+                                   fix_int (t->nice));
+          if (t->recent_cpu.f == old.f)
+            break;
+        }
+      epoch = mlfqs_epoch - DECAY_LOG_SIZE;
+    }
+  for (; epoch != mlfqs_epoch; epoch++)
+    t->recent_cpu = fix_add (fix_mul (decay_log[epoch % DECAY_LOG_SIZE],
+                                      t->recent_cpu),
+                             fix_int (t->nice));
+  t->recent_cpu_epoch = mlfqs_epoch;
+}
+
+/* Recomputes T's MLFQS priority from its up-to-date recent_cpu
+   and nice value:
+
+       priority = PRI_MAX - (recent_cpu / 4) - (nice * 2)
+
+   clamped to PRI_MIN...PRI_MAX.  Moves T within the run queue if
+   it is ready, but does not preempt. */
+static void
+mlfqs_update_priority (struct thread *t)
+{
+  int priority;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  mlfqs_sync (t);
+  priority = PRI_MAX - fix_trunc (fix_unscale (t->recent_cpu, 4))
+             - t->nice * 2;
+  if (priority < PRI_MIN)
+    priority = PRI_MIN;
+  else if (priority > PRI_MAX)
+    priority = PRI_MAX;
+
+  t->base_priority = priority;
+  thread_update_priority (t);
 }
 
 /* Idle thread.  Executes when no other thread is ready to run.
 
-   The idle thread is initially put on the ready list by
+   The BSP's idle thread is initially put on the ready list by
    thread_start().  It will be scheduled once initially, at which
-   point it initializes idle_thread, "up"s the semaphore passed
-   to it to enable thread_start() to continue, and immediately
-   blocks.  After that, the idle thread never appears in the
-   ready list.  It is returned by next_thread_to_run() as a
-   special case when the ready list is empty. */
+   point it initializes its CPU's idle_thread, "up"s the
+   semaphore passed to it to enable thread_start() to continue,
+   and immediately blocks.  After that, the idle thread never
+   appears in the ready list.  It is returned by
+   next_thread_to_run() as a special case when the ready list is
+   empty.  An application processor's idle thread instead starts
+   out running, with a null IDLE_STARTED. */
 static void
-idle (void *idle_started_ UNUSED)
+idle (void *idle_started_)
 {
   struct semaphore *idle_started = idle_started_;
-  idle_thread = thread_current ();
-  sema_up (idle_started);
+  thread_current ()->cpu->idle_thread = thread_current ();
+  if (idle_started != NULL)
+    sema_up (idle_started);
 
   for (;;)
     {
-      /* Let someone else run. */
+      /* Let someone else run.  Bring the timer back to periodic
+         mode first if the CPU went idle tickless. */
       intr_disable ();
+      timer_idle_exit ();
       thread_block ();
 
-      /* Re-enable interrupts and wait for the next one.
-
-         The `sti' instruction disables interrupts until the
-         completion of the next instruction, so these two
-         instructions are executed atomically.  This atomicity is
-         important; otherwise, an interrupt could be handled
-         between re-enabling interrupts and waiting for the next
-         one to occur, wasting as much as one clock tick worth of
-         time.
-
-         See [IA32-v2a] "HLT", [IA32-v2b] "STI", and [IA32-v3a]
-         7.11.1 "HLT Instruction". */
-      asm volatile ("sti; hlt" : : : "memory");
+      /* Threads in sub-tick sleeps are woken by polling, not by
+         an interrupt, so keep polling while there are any. */
+      if (timer_idle_poll ())
+        {
+          intr_enable ();
+          cpu_relax ();
+          continue;
+        }
+      timer_idle_enter ();
+
+      /* Re-enable interrupts and wait for the next one. */
+      intr_enable_and_wait ();
     }
 }
 
@@ -425,6 +1413,15 @@ kernel_thread (thread_func *function, void *aux)
   thread_exit ();       /* If function() returns, kill the thread. */
 }
 
+/* Returns the CPU that the caller is running on.  Until the
+   other CPUs start, that is always the BSP, even before
+   thread_init(). */
+struct cpu *
+cpu_current (void)
+{
+  return smp_active ? running_thread ()->cpu : &cpus[0];
+}
+
 /* Returns the running thread. */
 struct thread *
 running_thread (void)
@@ -447,9 +1444,9 @@ is_thread (struct thread *t)
 }
 
 /* Does basic initialization of T as a blocked thread named
-   NAME. */
+   NAME with the given TID, and adds it to the tid table. */
 static void
-init_thread (struct thread *t, const char *name, int priority)
+init_thread (struct thread *t, const char *name, int priority, tid_t tid)
 {
   enum intr_level old_level;
 
@@ -458,16 +1455,85 @@ init_thread (struct thread *t, const char *name, int priority)
   ASSERT (name != NULL);
 
   memset (t, 0, sizeof *t);
+  t->tid = tid;
   t->status = THREAD_BLOCKED;
   strlcpy (t->name, name, sizeof t->name);
   t->stack = (uint8_t *) t + PGSIZE;
   t->priority = priority;
+  t->base_priority = priority;
+  t->cpu = cpu_current ();
+  if (t != running_thread ())
+    t->group = running_thread ()->group;
+  list_init (&t->held_locks);
   t->magic = THREAD_MAGIC;
   list_init (&t->files);
 
   old_level = intr_disable ();
+  t->nice = NICE_DEFAULT;
+  t->recent_cpu = fix_int (0);
+  t->recent_cpu_epoch = mlfqs_epoch;
+  if (thread_mlfqs && t != running_thread ())
+    {
+      /* Inherit the creating thread's nice and recent_cpu. */
+      struct thread *parent = running_thread ();
+      mlfqs_sync (parent);
+      t->nice = parent->nice;
+      t->recent_cpu = parent->recent_cpu;
+      mlfqs_update_priority (t);
+    }
   list_push_back (&all_list, &t->allelem);
   intr_set_level (old_level);
+
+  if (t != initial_thread)
+    {
+      lock_acquire (&tid_lock);
+      hash_insert (&tid_table, &t->tidelem);
+      lock_release (&tid_lock);
+    }
+}
+
+/* Returns a page for a new thread, from the cache of dead
+   threads' pages if possible, or a null pointer if memory is
+   exhausted.  Only the part of the page that init_thread()
+   initializes, the struct thread, can be relied upon, unless
+   thread_zero_stacks is set. */
+static struct thread *
+alloc_thread_page (void)
+{
+  enum intr_level old_level;
+  struct thread *t = NULL;
+
+  old_level = intr_disable ();
+  if (thread_cache_cnt > 0)
+    {
+      t = thread_cache[--thread_cache_cnt];
+      thread_cache_hits++;
+    }
+  else
+    thread_cache_misses++;
+  intr_set_level (old_level);
+
+  if (t == NULL)
+    t = palloc_get_page (thread_zero_stacks ? PAL_ZERO : 0);
+  else if (thread_zero_stacks)
+    memset (t, 0, PGSIZE);
+  return t;
+}
+
+/* Frees the page of T, a dead thread, by adding it to the cache
+   of thread pages or, if the cache is full, returning it to the
+   page allocator.  Interrupts must be off. */
+static void
+free_thread_page (struct thread *t)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  /* Make sure a stale pointer to T fails is_thread(). */
+  t->magic = 0;
+  if (thread_cache_cnt < THREAD_CACHE_SIZE)
+    thread_cache[thread_cache_cnt++] = t;
+  else
+    palloc_free_page (t);
 }
 
 /* Allocates a SIZE-byte frame at the top of thread T's stack and
@@ -483,18 +1549,448 @@ alloc_frame (struct thread *t, size_t size)
   return t->stack;
 }
 
+/* Returns the index of the most significant set bit in X, which
+   must be nonzero.  See [IA32-v2a] "BSR--Bit Scan Reverse". */
+static inline int
+bit_scan_reverse (uint32_t x)
+{
+  uint32_t index;
+
+  ASSERT (x != 0);
+  asm ("bsrl %1, %0" : "=r" (index) : "rm" (x));
+  return index;
+}
+
+/* Adds T to the back of the run queue for its group and
+   priority, on the CPU that T's `cpu' member names, or to
+   rt_queue if T is a real-time thread. */
+static void
+ready_queue_push (struct thread *t)
+{
+  struct run_queue *rq = &run_queues[t->cpu->id];
+  struct thread_group *g = &groups[t->group];
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (PRI_MIN <= t->priority && t->priority <= PRI_MAX);
+
+  if (t->rt_runtime > 0)
+    {
+      heap_push (&rt_queue, &t->wait_elem);
+      ready_count++;
+      return;
+    }
+
+  /* A thread waking into a group with nothing ready brings the
+     group up to date. */
+  if (t->status == THREAD_BLOCKED && g->ready_cnt == 0
+      && g->vruntime < min_vruntime)
+    g->vruntime = min_vruntime;
+  g->ready_cnt++;
+
+  list_push_back (&rq->queues[t->group][t->priority], &t->elem);
+  rq->mask[t->group] |= (uint64_t) 1 << t->priority;
+  rq->groups |= 1u << t->group;
+  rq->count++;
+  ready_count++;
+}
+
+/* Removes T, which must be ready, from its run queue. */
+static void
+ready_queue_remove (struct thread *t)
+{
+  struct run_queue *rq = &run_queues[t->cpu->id];
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (t->status == THREAD_READY);
+
+  if (t->rt_runtime > 0)
+    {
+      heap_remove (&rt_queue, &t->wait_elem);
+      ready_count--;
+      return;
+    }
+  list_remove (&t->elem);
+  if (list_empty (&rq->queues[t->group][t->priority]))
+    {
+      rq->mask[t->group] &= ~((uint64_t) 1 << t->priority);
+      if (rq->mask[t->group] == 0)
+        rq->groups &= ~(1u << t->group);
+    }
+  groups[t->group].ready_cnt--;
+  rq->count--;
+  ready_count--;
+}
+
+/* Returns the CPU group that RQ should run a thread from: the
+   one with the least virtual run time among the groups that
+   have threads in RQ and are not throttled.  Returns -1 if
+   there is none. */
+static int
+ready_queue_group (struct run_queue *rq)
+{
+  int best = -1;
+  int group;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  /* Group 0 cannot be throttled. */
+  if (rq->groups == 0)
+    return -1;
+  else if (rq->groups == 1)
+    return 0;
+
+  for (group = 0; group < GROUP_CNT; group++)
+    if ((rq->groups & (1u << group)) != 0 && !groups[group].throttled
+        && (best < 0 || groups[group].vruntime < groups[best].vruntime))
+      best = group;
+  return best;
+}
+
+/* Returns the highest priority among the threads of GROUP in
+   RQ, or -1 if there are none.  Runs in constant time. */
+static int
+ready_queue_max_priority (struct run_queue *rq, int group)
+{
+  uint32_t high = rq->mask[group] >> 32;
+  uint32_t low = rq->mask[group];
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (high != 0)
+    return 32 + bit_scan_reverse (high);
+  else if (low != 0)
+    return bit_scan_reverse (low);
+  else
+    return -1;
+}
+
+/* Returns the thread that RQ should run next, the front of the
+   highest-priority nonempty queue of the group chosen by
+   ready_queue_group(), without removing it.  Returns a null
+   pointer if RQ has no thread that may run. */
+static struct thread *
+ready_queue_peek (struct run_queue *rq)
+{
+  int group = ready_queue_group (rq);
+  int priority;
+
+  if (group < 0)
+    return NULL;
+  priority = ready_queue_max_priority (rq, group);
+  return list_entry (list_front (&rq->queues[group][priority]),
+                     struct thread, elem);
+}
+
+/* Removes and returns the thread that RQ should run next, which
+   there must be. */
+static struct thread *
+ready_queue_pop (struct run_queue *rq)
+{
+  struct thread *t = ready_queue_peek (rq);
+
+  ASSERT (t != NULL);
+  ready_queue_remove (t);
+  return t;
+}
+
+/* Returns the CPU on whose run queue T should be put when it
+   becomes ready.  That is the CPU T last ran on, to keep its
+   cache warm, unless T would have to wait there while another
+   CPU sits idle, or while another CPU runs a thread that T
+   outranks.  In the latter case the CPU running the lowest
+   ranked such thread is chosen, and thread_unblock() asks it to
+   reschedule. */
+static struct cpu *
+select_cpu (struct thread *t)
+{
+  struct cpu *cpu = t->cpu;
+  struct cpu *victim = NULL;
+  int i;
+
+  if (!smp_active
+      || (cpu->running == cpu->idle_thread
+          && run_queues[cpu->id].count == 0)
+      || thread_precedes (t, cpu->running))
+    return cpu;
+
+  for (i = 0; i < cpu_cnt; i++)
+    {
+      struct cpu *c = &cpus[i];
+      if (!c->started)
+        continue;
+      if (c->running == c->idle_thread && run_queues[i].count == 0)
+        return c;
+      if (thread_precedes (t, c->running)
+          && (victim == NULL
+              || thread_precedes (victim->running, c->running)))
+        victim = c;
+    }
+  return victim != NULL ? victim : cpu;
+}
+
+/* Returns true if A should run rather than B: real-time threads
+   before others, then by earlier deadline, by CPU group, or by
+   higher priority within a group. */
+static bool
+thread_precedes (const struct thread *a, const struct thread *b)
+{
+  if ((a->rt_runtime > 0) != (b->rt_runtime > 0))
+    return a->rt_runtime > 0;
+  else if (a->rt_runtime > 0)
+    return a->rt_abs_deadline < b->rt_abs_deadline;
+  else if (a->group != b->group)
+    return group_precedes (&groups[a->group], &groups[b->group]);
+  else
+    return a->priority > b->priority;
+}
+
+/* Returns true if a ready real-time thread should run instead of
+   CUR. */
+static bool
+rt_preempts (struct thread *cur)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  return (!heap_empty (&rt_queue)
+          && thread_precedes (heap_entry (heap_max (&rt_queue),
+                                          struct thread, wait_elem), cur));
+}
+
+/* Returns true if real-time thread A's deadline is later than
+   B's, so that rt_queue's maximum has the earliest deadline. */
+static bool
+rt_deadline_less (const struct heap_elem *a_, const struct heap_elem *b_,
+                  void *aux UNUSED)
+{
+  const struct thread *a = heap_entry (a_, struct thread, wait_elem);
+  const struct thread *b = heap_entry (b_, struct thread, wait_elem);
+
+  return a->rt_abs_deadline > b->rt_abs_deadline;
+}
+
+/* Returns the density of a real-time thread with the given
+   RUNTIME and DEADLINE, in units of 1/RT_UNIT, rounded up.
+   Computed in 64 bits because RUNTIME * RT_UNIT may not fit in
+   an int; the result does, since RUNTIME <= DEADLINE. */
+static int
+rt_density_of (int runtime, int deadline)
+{
+  return DIV_ROUND_UP ((int64_t) runtime * RT_UNIT, deadline);
+}
+
+/* Called on CPU 0 every tick NOW.  Counts the deadline misses of
+   real-time threads and starts their new periods. */
+static void
+rt_tick (int64_t now)
+{
+  struct list_elem *e;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  for (e = list_begin (&rt_list); e != list_end (&rt_list);
+       e = list_next (e))
+    {
+      struct thread *t = list_entry (e, struct thread, rtelem);
+
+      if (!t->rt_done && !t->rt_missed && now >= t->rt_abs_deadline)
+        {
+          t->rt_missed = true;
+          t->schedstat.deadline_misses++;
+        }
+      if (now >= t->rt_next_release)
+        rt_release (t, now);
+    }
+}
+
+/* Starts a new period of real-time thread T at tick NOW: refills
+   its budget, sets its deadline, and wakes it if it was
+   throttled. */
+static void
+rt_release (struct thread *t, int64_t now)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  t->rt_budget = t->rt_runtime;
+  t->rt_abs_deadline = now + t->rt_deadline;
+  t->rt_next_release = now + t->rt_period;
+  t->rt_done = false;
+  t->rt_missed = false;
+  if (t->status == THREAD_READY)
+    heap_update (&rt_queue, &t->wait_elem);
+  else if (t->rt_throttled)
+    {
+      t->rt_throttled = false;
+      thread_unblock (t);
+    }
+}
+
+/* Takes T, the running thread, out of the real-time class. */
+static void
+rt_leave (struct thread *t)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (t->rt_runtime > 0);
+
+  rt_density -= rt_density_of (t->rt_runtime, t->rt_deadline);
+  list_remove (&t->rtelem);
+  t->rt_runtime = 0;
+  thread_update_priority (t);
+}
+
+/* Returns true if a thread of group A should preempt one of
+   group B: A is not throttled, and B is or has run more than a
+   tick longer than A, as weighted. */
+static bool
+group_precedes (const struct thread_group *a, const struct thread_group *b)
+{
+  return (!a->throttled
+          && (b->throttled || a->vruntime + GROUP_WAKEUP_GRAN < b->vruntime));
+}
+
+/* Charges group G for a tick run by one of its threads.
+   Returns true if G is throttled, in which case the thread
+   should yield. */
+static bool
+group_charge (struct thread_group *g)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  g->ticks++;
+  g->vruntime += GROUP_VRUNTIME_SCALE / g->weight;
+  if (g->quota != 0 && ++g->used >= g->quota && !g->throttled)
+    {
+      g->throttled = true;
+      g->throttle_cnt++;
+    }
+  return g->throttled;
+}
+
+/* Called on CPU 0 every tick NOW.  Starts the capped groups'
+   new periods. */
+static void
+group_tick (int64_t now)
+{
+  int group;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  for (group = 1; group < GROUP_CNT; group++)
+    {
+      struct thread_group *g = &groups[group];
+
+      if (g->quota == 0 || now < g->period_end)
+        continue;
+      g->used = 0;
+      g->period_end = now + GROUP_PERIOD;
+      if (g->throttled)
+        group_unthrottle (group);
+    }
+}
+
+/* Lets GROUP's threads run again, waking up the CPUs that have
+   some of them ready but nothing to run. */
+static void
+group_unthrottle (int group)
+{
+  int i;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  groups[group].throttled = false;
+  for (i = 0; i < cpu_cnt; i++)
+    {
+      struct cpu *c = &cpus[i];
+
+      if ((run_queues[i].groups & (1u << group)) == 0
+          || c->running != c->idle_thread)
+        continue;
+      if (c != cpu_current ())
+        smp_reschedule (c);
+      else if (intr_context ())
+        intr_yield_on_return ();
+    }
+}
+
+/* Returns true if a group with WEIGHT and CAP would restrict its
+   threads at least as much as group G does. */
+static bool
+group_restricts (int weight, int cap, const struct thread_group *g)
+{
+  return (weight <= g->weight
+          && (g->cap == 0 || (cap != 0 && cap <= g->cap)));
+}
+
+/* Returns true if some thread other than EXCEPT, and not about
+   to die, is in GROUP. */
+static bool
+group_in_use (int group, const struct thread *except)
+{
+  struct list_elem *e;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  for (e = list_begin (&all_list); e != list_end (&all_list);
+       e = list_next (e))
+    {
+      struct thread *t = list_entry (e, struct thread, allelem);
+
+      if (t != except && t->group == group && t->status != THREAD_DYING)
+        return true;
+    }
+  return false;
+}
+
 /* Chooses and returns the next thread to be scheduled.  Should
    return a thread from the run queue, unless the run queue is
    empty.  (If the running thread can continue running, then it
    will be in the run queue.)  If the run queue is empty, return
-   idle_thread. */
+   idle_thread.
+
+   Picks the real-time thread with the earliest deadline, if
+   any, and otherwise, from the CPU group that has run least,
+   the front of the highest-priority nonempty queue, so threads
+   of equal priority are scheduled round-robin.  If this CPU's
+   run queue has nothing to run, steals the highest-priority
+   such thread queued on another CPU instead of going idle. */
 static struct thread *
 next_thread_to_run (void)
 {
-  if (list_empty (&ready_list))
-    return idle_thread;
+  struct cpu *cpu = cpu_current ();
+  struct run_queue *victim = NULL;
+  struct thread *next;
+  int best = -1;
+  int i;
+
+  if (!heap_empty (&rt_queue))
+    {
+      next = heap_entry (heap_pop_max (&rt_queue), struct thread, wait_elem);
+      ready_count--;
+      next->cpu = cpu;
+      return next;
+    }
+  if (ready_queue_peek (&run_queues[cpu->id]) != NULL)
+    next = ready_queue_pop (&run_queues[cpu->id]);
   else
-    return list_entry (list_pop_front (&ready_list), struct thread, elem);
+    {
+      for (i = 0; i < cpu_cnt; i++)
+        {
+          struct thread *t = ready_queue_peek (&run_queues[i]);
+          if (t != NULL && t->priority > best)
+            {
+              best = t->priority;
+              victim = &run_queues[i];
+            }
+        }
+      if (victim == NULL)
+        return cpu->idle_thread;
+
+      next = ready_queue_pop (victim);
+      next->cpu = cpu;
+    }
+
+  if (groups[next->group].vruntime > min_vruntime)
+    min_vruntime = groups[next->group].vruntime;
+  return next;
 }
 
 /* Completes a thread switch by activating the new thread's page
@@ -522,9 +2018,31 @@ thread_schedule_tail (struct thread *prev)
 
   /* Mark us as running. */
   cur->status = THREAD_RUNNING;
+  cur->cpu->running = cur;
 
   /* Start new time slice. */
-  thread_ticks = 0;
+  cur->cpu->thread_ticks = 0;
+  cur->cpu->need_resched = false;
+
+  /* Account for the time we spent ready. */
+  if (cur != cur->cpu->idle_thread)
+    {
+      struct schedstat *st = &cur->schedstat;
+      int64_t wait = timer_elapsed (cur->ready_since);
+
+      st->ready_ticks += wait;
+      if (wait > st->max_ready_ticks)
+        st->max_ready_ticks = wait;
+      if (cur->woken)
+        {
+          int bucket = 0;
+          while (bucket < SCHEDSTAT_LATENCY_BUCKETS - 1
+                 && wait >= (1 << bucket))
+            bucket++;
+          st->wakeup_latency[bucket]++;
+          cur->woken = false;
+        }
+    }
 
 #ifdef USERPROG
   /* Activate the new address space. */
@@ -539,7 +2057,7 @@ thread_schedule_tail (struct thread *prev)
   if (prev != NULL && prev->status == THREAD_DYING && prev != initial_thread)
     {
       ASSERT (prev != cur);
-      palloc_free_page (prev);
+      free_thread_page (prev);
     }
 }
 
@@ -562,22 +2080,104 @@ schedule (void)
   ASSERT (is_thread (next));
 
   if (cur != next)
-    prev = switch_threads (cur, next);
+    {
+      if (cur->status == THREAD_BLOCKED)
+        cur->schedstat.voluntary_switches++;
+      else if (cur->status == THREAD_READY)
+        cur->schedstat.involuntary_switches++;
+      fpu_switch (cur, next);
+      prev = switch_threads (cur, next);
+    }
   thread_schedule_tail (prev);
 }
 
-/* Returns a tid to use for a new thread. */
+/* Returns a tid to use for a new thread, or TID_ERROR if all
+   tids are in use. */
 static tid_t
 allocate_tid (void)
 {
-  static tid_t next_tid = 1;
-  tid_t tid;
+  size_t idx;
 
   lock_acquire (&tid_lock);
-  tid = next_tid++;
+  idx = bitmap_scan_and_flip (tid_map, 0, 1, false);
   lock_release (&tid_lock);
 
-  return tid;
+  return idx != BITMAP_ERROR ? (tid_t) idx : TID_ERROR;
+}
+
+/* Makes TID available for reuse.  tid_lock must be held. */
+static void
+free_tid (tid_t tid)
+{
+  ASSERT (lock_held_by_current_thread (&tid_lock));
+  ASSERT (bitmap_test (tid_map, tid));
+
+  bitmap_reset (tid_map, tid);
+}
+
+/* Adds the statistics in B to those in A. */
+static void
+schedstat_add (struct schedstat *a, const struct schedstat *b)
+{
+  int i;
+
+  a->user_ticks += b->user_ticks;
+  a->kernel_ticks += b->kernel_ticks;
+  a->ready_ticks += b->ready_ticks;
+  if (b->max_ready_ticks > a->max_ready_ticks)
+    a->max_ready_ticks = b->max_ready_ticks;
+  a->voluntary_switches += b->voluntary_switches;
+  a->involuntary_switches += b->involuntary_switches;
+  a->deadline_misses += b->deadline_misses;
+  for (i = 0; i < SCHEDSTAT_LATENCY_BUCKETS; i++)
+    a->wakeup_latency[i] += b->wakeup_latency[i];
+}
+
+/* Prints ST, the statistics of the thread with the given NAME
+   and TID, as one line. */
+static void
+schedstat_print (const char *name, tid_t tid, const struct schedstat *st)
+{
+  int i;
+
+  if (tid != TID_ERROR)
+    printf ("  %-16s %4d:", name, tid);
+  else
+    printf ("  %-21s:", name);
+  printf (" %lld/%lld/%lld/%lld, %u/%u, %u,",
+          st->user_ticks, st->kernel_ticks,
+          st->ready_ticks, st->max_ready_ticks,
+          st->voluntary_switches, st->involuntary_switches,
+          st->deadline_misses);
+  for (i = 0; i < SCHEDSTAT_LATENCY_BUCKETS; i++)
+    printf (" %u", st->wakeup_latency[i]);
+  printf ("\n");
+}
+
+/* Prints thread T's scheduling statistics.  For use with
+   thread_foreach(). */
+static void
+schedstat_print_thread (struct thread *t, void *aux UNUSED)
+{
+  schedstat_print (t->name, t->tid, &t->schedstat);
+}
+
+/* Returns a hash value for thread T's tid. */
+static unsigned
+tid_hash (const struct hash_elem *t_, void *aux UNUSED)
+{
+  const struct thread *t = hash_entry (t_, struct thread, tidelem);
+  return hash_int (t->tid);
+}
+
+/* Returns true if thread A's tid is less than thread B's. */
+static bool
+tid_less (const struct hash_elem *a_, const struct hash_elem *b_,
+          void *aux UNUSED)
+{
+  const struct thread *a = hash_entry (a_, struct thread, tidelem);
+  const struct thread *b = hash_entry (b_, struct thread, tidelem);
+  return a->tid < b->tid;
 }
 
 /* Offset of `stack' member within `struct thread'.
@@ -2,7 +2,9 @@
 #define THREADS_THREAD_H
 
 #include <debug.h>
+#include <hash.h>
 #include <list.h>
+#include <schedstat.h>
 #include <stdint.h>
 #include "threads/synch.h"
 #include "threads/fixed-point.h"
@@ -26,6 +28,17 @@ typedef int tid_t;
 #define PRI_DEFAULT 31                  /* Default priority. */
 #define PRI_MAX 63                      /* Highest priority. */
 
+/* Thread niceness, for the multi-level feedback queue scheduler. */
+#define NICE_MIN -20                    /* Least nice (highest priority). */
+#define NICE_DEFAULT 0                  /* Default niceness. */
+#define NICE_MAX 20                     /* Nicest (lowest priority). */
+
+/* CPU groups. */
+#define GROUP_CNT 8                     /* Number of groups. */
+#define GROUP_WEIGHT_MIN 1              /* Smallest share. */
+#define GROUP_WEIGHT_DEFAULT 1024       /* Default share. */
+#define GROUP_WEIGHT_MAX 65536          /* Largest share. */
+
 /* A kernel thread or user process.
 
    Each thread structure is stored in its own 4 kB page.  The
@@ -80,12 +93,14 @@ typedef int tid_t;
    这里在分割符中存放一个magic数，如果发生上面两个问题，这个margic数就会被改变，也就能被检测到
 */
 
-/* The `elem' member has a dual purpose.  It can be an element in
-   the run queue (thread.c), or it can be an element in a
-   semaphore wait list (synch.c).  It can be used these two ways
-   only because they are mutually exclusive: only a thread in the
-   ready state is on the run queue, whereas only a thread in the
-   blocked state is on a semaphore wait list. */
+/* The `elem' member has a triple purpose.  It can be an element
+   in the run queue (thread.c), an element in a semaphore wait
+   list (synch.c), or an element in the sleep list
+   (devices/timer.c).  It can be used these ways only because
+   they are mutually exclusive: only a thread in the ready state
+   is on the run queue, whereas only a thread in the blocked
+   state is on a semaphore wait list or the sleep list, and a
+   blocked thread waits for only one thing at a time. */
 struct thread
 {
     /* Owned by thread.c. */
@@ -93,16 +108,66 @@ struct thread
     enum thread_status status;          /* Thread state. */
     char               name[16];                      /* Name (for debugging purposes). */
     uint8_t            *stack;                     /* Saved stack pointer. */
-    int                priority;                       /* Priority. */
+    int                priority;                       /* Effective priority. */
+    int                base_priority;      /* Priority before donations. */
     struct list_elem   allelem;           /* List element for all threads list. */
+    struct hash_elem   tidelem;            /* Element in tid table. */
+    struct cpu         *cpu;               /* CPU we run, last ran, or queue on. */
+    int                preempt_count;      /* Preemptible only if zero. */
 
     /* Shared between thread.c and synch.c. */
+    struct list        held_locks;         /* Locks we hold. */
+    struct lock        *waiting_lock;      /* Lock we are blocked on, if any. */
+    struct heap_elem   wait_elem;          /* In `wait_queue', or rt_queue. */
+    struct heap        *wait_queue;        /* Queue we are blocked on, if any. */
+
+    /* Shared between thread.c, synch.c and devices/timer.c. */
     struct list_elem elem;              /* List element. */
 
+    /* Owned by thread.c, for the MLFQS. */
+    int                nice;               /* Niceness. */
+    fixed_point_t      recent_cpu;         /* Recent CPU usage. */
+    unsigned           recent_cpu_epoch;   /* Second recent_cpu is current as of. */
+
+    /* Owned by thread.c, for the real-time class, in ticks. */
+    int                rt_runtime;         /* Budget per period, 0 if not RT. */
+    int                rt_period;          /* Period. */
+    int                rt_deadline;        /* Deadline, from period start. */
+    int                rt_budget;          /* Budget left this period. */
+    int64_t            rt_abs_deadline;    /* Deadline of current job. */
+    int64_t            rt_next_release;    /* Start of next period. */
+    bool               rt_done;            /* Current job finished? */
+    bool               rt_missed;          /* Current job missed deadline? */
+    bool               rt_throttled;       /* Blocked until next release? */
+    struct list_elem   rtelem;             /* Element in rt_list. */
+
+    /* Owned by thread.c, for CPU groups. */
+    int                group;              /* CPU group, 0...GROUP_CNT-1. */
+
+    /* Owned by thread.c, for schedstat. */
+    struct schedstat   schedstat;          /* Scheduling statistics. */
+    int64_t            ready_since;        /* Tick we last became ready. */
+    bool               woken;              /* Ready by thread_unblock()? */
+
+    /* Owned by threads/fpu.c. */
+    void               *fpu_state;         /* FXSAVE area, or null if unused. */
+    void               *fpu_block;         /* Allocation holding fpu_state. */
+    struct cpu         *fpu_cpu;           /* CPU that last loaded fpu_state. */
+
+    /* Owned by devices/timer.c. */
+    int64_t          wakeup_tick;       /* Tick to wake up at, if sleeping. */
+    int64_t          wakeup_ns;         /* Same, for a sub-tick sleep. */
+
 //#ifdef USERPROG
     /* Owned by userprog/process.c. */
     uint32_t    *pagedir;                  /* Page directory. */
     struct list files;                     /* The file list maintained by the thread */
+#ifdef VM
+    struct file *exec_file;                /* Executable, read on demand. */
+
+    /* Owned by vm/page.c. */
+    struct hash pages;                     /* Supplemental page table. */
+#endif
 
 //#endif
 
@@ -115,9 +180,21 @@ struct thread
    Controlled by kernel command-line option "-o mlfqs". */
 extern bool thread_mlfqs;
 
+/* If true, zero each new thread's whole page, stack included,
+   instead of only its struct thread.  A debugging aid.
+   Controlled by kernel command-line option "-zerostack". */
+extern bool thread_zero_stacks;
+
+/* If true, print each thread's scheduling statistics at
+   shutdown.  They are always collected.
+   Controlled by kernel command-line option "-schedstat". */
+extern bool thread_schedstat;
+
 void thread_init (void);
 
 void thread_start (void);
+struct thread *thread_create_idle (struct cpu *);
+void thread_start_ap (void) NO_RETURN;
 
 void thread_tick (void);
 
@@ -134,6 +211,18 @@ void thread_unblock (struct thread *);
 struct thread *thread_current (void);
 
 tid_t thread_tid (void);
+struct thread *thread_by_tid (tid_t);
+bool thread_get_schedstat (tid_t, struct schedstat *);
+
+bool thread_set_rt (int runtime, int period, int deadline);
+void thread_rt_yield (void);
+int64_t thread_next_release (void);
+
+bool thread_group_config (int group, int weight, int cap);
+bool thread_set_group (int group);
+bool thread_restrict_group (int group);
+bool thread_group_tighten (int group, int weight, int cap);
+int thread_get_group (void);
 
 const char *thread_name (void);
 
@@ -141,6 +230,13 @@ void thread_exit (void) NO_RETURN;
 
 void thread_yield (void);
 
+void thread_preempt (void);
+void preempt_disable (void);
+void preempt_enable (void);
+void cond_resched (void);
+
+void thread_update_priority (struct thread *);
+
 /* Performs some operation on thread t, given auxiliary data AUX. */
 typedef void thread_action_func (struct thread *t, void *aux);
 
@@ -0,0 +1,126 @@
+#include "threads/workqueue.h"
+#include <debug.h>
+#include <stdio.h>
+#include "threads/interrupt.h"
+#include "threads/thread.h"
+
+/* Work queues.
+
+   Interrupt handlers run with interrupts off, so anything that
+   an interrupt handler does that can wait a little is better
+   handed to a thread: the handler queues a `struct work' and
+   returns, and one of the queue's worker threads runs the work
+   soon after, with interrupts on.  Workers are ordinary kernel
+   threads, so work may also sleep, for example to acquire a
+   lock.
+
+   A work is queued at most once at a time: queueing a work that
+   is already pending does nothing, so the work must be written
+   to do everything that has accumulated by the time it runs. */
+
+struct workqueue wq_high;
+struct workqueue wq_default;
+
+static thread_func worker;
+
+/* Initializes WORK to call FUNC, passing AUX, when it runs. */
+void
+work_init (struct work *work, work_func *func, void *aux)
+{
+  ASSERT (work != NULL);
+  ASSERT (func != NULL);
+
+  work->func = func;
+  work->aux = aux;
+  work->pending = false;
+}
+
+/* Initializes WQ and starts WORKER_CNT worker threads for it,
+   named after NAME, at the given PRIORITY.  Under the MLFQS,
+   which sets priorities itself, workers are instead given the
+   lowest nice value. */
+void
+workqueue_init (struct workqueue *wq, const char *name, int priority,
+                int worker_cnt)
+{
+  int i;
+
+  ASSERT (wq != NULL);
+  ASSERT (PRI_MIN <= priority && priority <= PRI_MAX);
+  ASSERT (worker_cnt > 0);
+
+  wq->name = name;
+  wq->priority = priority;
+  list_init (&wq->works);
+  sema_init (&wq->work_cnt, 0);
+
+  for (i = 0; i < worker_cnt; i++)
+    {
+      char thread_name[16];
+      snprintf (thread_name, sizeof thread_name, "%s/%d", name, i);
+      if (thread_create (thread_name, priority, worker, wq) == TID_ERROR)
+        PANIC ("%s: cannot create worker thread", name);
+    }
+}
+
+/* Creates wq_high and wq_default.  Called by thread_start(). */
+void
+workqueue_init_system (void)
+{
+  workqueue_init (&wq_high, "wq-high", PRI_MAX, 1);
+  workqueue_init (&wq_default, "wq", PRI_DEFAULT, 2);
+}
+
+/* Adds WORK to WQ, unless it is already pending, and returns
+   true if it was added.
+
+   This function may be called from an interrupt handler. */
+bool
+queue_work (struct workqueue *wq, struct work *work)
+{
+  enum intr_level old_level;
+  bool queued;
+
+  ASSERT (wq != NULL);
+  ASSERT (work != NULL);
+
+  old_level = intr_disable ();
+  queued = !work->pending;
+  if (queued)
+    {
+      work->pending = true;
+      list_push_back (&wq->works, &work->elem);
+      sema_up (&wq->work_cnt);
+    }
+  intr_set_level (old_level);
+
+  return queued;
+}
+
+/* A worker thread for the workqueue WQ_: runs its pending work,
+   oldest first, forever. */
+static void
+worker (void *wq_)
+{
+  struct workqueue *wq = wq_;
+
+  if (thread_mlfqs)
+    thread_set_nice (NICE_MIN);
+
+  for (;;)
+    {
+      enum intr_level old_level;
+      struct work *work;
+
+      sema_down (&wq->work_cnt);
+
+      /* Clear `pending' before running the work, so that it can
+         be queued again while it runs. */
+      old_level = intr_disable ();
+      work = list_entry (list_pop_front (&wq->works), struct work, elem);
+      work->pending = false;
+      intr_set_level (old_level);
+
+      work->func (work->aux);
+    }
+}
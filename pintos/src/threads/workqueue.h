@@ -0,0 +1,43 @@
+#ifndef THREADS_WORKQUEUE_H
+#define THREADS_WORKQUEUE_H
+
+#include <list.h>
+#include <stdbool.h>
+#include "threads/synch.h"
+
+/* A function to run later, in a worker thread. */
+typedef void work_func (void *aux);
+
+/* A piece of deferred work.  Usually static or embedded in the
+   structure that it works on, so that queueing it does not have
+   to allocate memory. */
+struct work
+  {
+    struct list_elem elem;      /* Element in workqueue's `works'. */
+    work_func *func;            /* Function to call. */
+    void *aux;                  /* Argument for FUNC. */
+    bool pending;               /* Queued but not yet started? */
+  };
+
+/* A queue of work and the threads that run it. */
+struct workqueue
+  {
+    const char *name;           /* Name, for worker threads. */
+    int priority;               /* Priority of worker threads. */
+    struct list works;          /* Pending work, oldest first. */
+    struct semaphore work_cnt;  /* Number of pending works. */
+  };
+
+/* Queues created by workqueue_init_system(): one whose workers
+   run ahead of every other thread, for work deferred from
+   interrupt handlers, and one at the default priority. */
+extern struct workqueue wq_high;
+extern struct workqueue wq_default;
+
+void work_init (struct work *, work_func *, void *aux);
+void workqueue_init (struct workqueue *, const char *name, int priority,
+                     int worker_cnt);
+void workqueue_init_system (void);
+bool queue_work (struct workqueue *, struct work *);
+
+#endif /* threads/workqueue.h */
@@ -0,0 +1,133 @@
+#include "userprog/futex.h"
+#include <debug.h>
+#include <hash.h>
+#include <list.h>
+#include "userprog/pagedir.h"
+#include "threads/interrupt.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+
+/* Futexes.
+
+   A futex is an int in user memory.  User code changes it with
+   atomic instructions and enters the kernel only to sleep until
+   it changes, with futex_wait(), or to wake threads sleeping on
+   it, with futex_wake(), so that, for example, a user mutex
+   that is not contended never needs a system call.
+
+   Sleeping threads are kept in a hash table of FUTEX_BUCKETS
+   lists, keyed by the kernel virtual address that the futex
+   maps to.  That address stands for the futex's physical frame
+   and offset, so processes that share a frame share its
+   futexes.  futex_wait() checks the futex's value and queues
+   the thread with interrupts off, so a futex_wake() cannot slip
+   in between and be lost. */
+#define FUTEX_BUCKETS 64
+
+/* A thread sleeping in futex_wait(). */
+struct futex_waiter
+  {
+    struct list_elem elem;      /* Element in bucket. */
+    const int *key;             /* Kernel address of the futex. */
+    struct thread *thread;      /* Sleeping thread. */
+  };
+
+static struct list buckets[FUTEX_BUCKETS];
+
+static struct list *bucket_for (const int *key);
+static const int *futex_key (uint32_t *pd, int *uaddr);
+
+/* Initializes the futex hash table. */
+void
+futex_init (void)
+{
+  size_t i;
+
+  for (i = 0; i < FUTEX_BUCKETS; i++)
+    list_init (&buckets[i]);
+}
+
+/* If the futex at user address UADDR in page directory PD still
+   holds EXPECTED, sleeps until futex_wake() wakes it, and
+   returns true.  Otherwise returns false at once.  UADDR must be
+   aligned and mapped. */
+bool
+futex_wait (uint32_t *pd, int *uaddr, int expected)
+{
+  const int *key = futex_key (pd, uaddr);
+  struct futex_waiter w;
+  enum intr_level old_level;
+
+  old_level = intr_disable ();
+  if (*key != expected)
+    {
+      intr_set_level (old_level);
+      return false;
+    }
+  w.key = key;
+  w.thread = thread_current ();
+  list_push_back (bucket_for (key), &w.elem);
+  thread_block ();
+  intr_set_level (old_level);
+  return true;
+}
+
+/* Wakes up to N threads sleeping on the futex at user address
+   UADDR in page directory PD, highest priority first and FIFO
+   within a priority, and returns the number woken.  UADDR must
+   be aligned and mapped. */
+int
+futex_wake (uint32_t *pd, int *uaddr, int n)
+{
+  const int *key = futex_key (pd, uaddr);
+  struct list *bucket = bucket_for (key);
+  enum intr_level old_level;
+  int woken;
+
+  old_level = intr_disable ();
+  for (woken = 0; woken < n; woken++)
+    {
+      struct futex_waiter *best = NULL;
+      struct list_elem *e;
+
+      for (e = list_begin (bucket); e != list_end (bucket);
+           e = list_next (e))
+        {
+          struct futex_waiter *w = list_entry (e, struct futex_waiter, elem);
+          if (w->key == key
+              && (best == NULL
+                  || w->thread->priority > best->thread->priority))
+            best = w;
+        }
+      if (best == NULL)
+        break;
+      list_remove (&best->elem);
+      thread_unblock (best->thread);
+    }
+  intr_set_level (old_level);
+  if (old_level == INTR_ON)
+    thread_preempt ();
+  return woken;
+}
+
+/* Returns the hash bucket for futex KEY. */
+static struct list *
+bucket_for (const int *key)
+{
+  return &buckets[hash_int ((uintptr_t) key) % FUTEX_BUCKETS];
+}
+
+/* Returns the kernel virtual address of the futex at user
+   address UADDR in page directory PD. */
+static const int *
+futex_key (uint32_t *pd, int *uaddr)
+{
+  const int *key;
+
+  ASSERT ((uintptr_t) uaddr % sizeof *uaddr == 0);
+  ASSERT (is_user_vaddr (uaddr));
+
+  key = pagedir_get_page (pd, uaddr);
+  ASSERT (key != NULL);
+  return key;
+}
@@ -0,0 +1,11 @@
+#ifndef USERPROG_FUTEX_H
+#define USERPROG_FUTEX_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+void futex_init (void);
+bool futex_wait (uint32_t *pd, int *uaddr, int expected);
+int futex_wake (uint32_t *pd, int *uaddr, int n);
+
+#endif /* userprog/futex.h */
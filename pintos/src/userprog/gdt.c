@@ -2,6 +2,7 @@
 #include <debug.h>
 #include "userprog/tss.h"
 #include "threads/palloc.h"
+#include "threads/smp.h"
 #include "threads/vaddr.h"
 
 /* The Global Descriptor Table (GDT).
@@ -21,22 +22,24 @@
 
    For more information on the GDT as used here, refer to
    [IA32-v3a] 3.2 "Using Segments" through 3.5 "System Descriptor
-   Types". */
-static uint64_t gdt[SEL_CNT];
+   Types".
+
+   Each CPU has its own TSS.  CPU 0's descriptor is at SEL_TSS
+   and the others follow it, one per CPU. */
+static uint64_t gdt[SEL_CNT + CPU_MAX - 1];
 
 /* GDT helpers. */
 static uint64_t make_code_desc (int dpl);
 static uint64_t make_data_desc (int dpl);
 static uint64_t make_tss_desc (void *laddr);
 static uint64_t make_gdtr_operand (uint16_t limit, void *base);
+static void load_gdt (void);
 
 /* Sets up a proper GDT.  The bootstrap loader's GDT didn't
    include user-mode selectors or a TSS, but we need both now. */
 void
 gdt_init (void)
 {
-  uint64_t gdtr_operand;
-
   /* Initialize GDT. */
   gdt[SEL_NULL / sizeof *gdt] = 0;
   gdt[SEL_KCSEG / sizeof *gdt] = make_code_desc (0);
@@ -44,13 +47,33 @@ gdt_init (void)
   gdt[SEL_UCSEG / sizeof *gdt] = make_code_desc (3);
   gdt[SEL_UDSEG / sizeof *gdt] = make_data_desc (3);
   gdt[SEL_TSS / sizeof *gdt] = make_tss_desc (tss_get ());
+  load_gdt ();
+}
+
+/* Adds a descriptor for the running application processor's
+   TSS, which tss_init() must already have set up, and loads the
+   GDT and that TSS. */
+void
+gdt_init_ap (void)
+{
+  int id = cpu_current ()->id;
+
+  ASSERT (id > 0 && id < CPU_MAX);
+  gdt[SEL_TSS / sizeof *gdt + id] = make_tss_desc (tss_get ());
+  load_gdt ();
+}
+
+/* Loads GDTR, and TR with the running CPU's TSS.  See [IA32-v3a]
+   2.4.1 "Global Descriptor Table Register (GDTR)", 2.4.4 "Task
+   Register (TR)", and 6.2.4 "Task Register".  */
+static void
+load_gdt (void)
+{
+  uint64_t gdtr_operand = make_gdtr_operand (sizeof gdt - 1, gdt);
+  uint16_t sel_tss = SEL_TSS + cpu_current ()->id * sizeof *gdt;
 
-  /* Load GDTR, TR.  See [IA32-v3a] 2.4.1 "Global Descriptor
-     Table Register (GDTR)", 2.4.4 "Task Register (TR)", and
-     6.2.4 "Task Register".  */
-  gdtr_operand = make_gdtr_operand (sizeof gdt - 1, gdt);
   asm volatile ("lgdt %0" : : "m" (gdtr_operand));
-  asm volatile ("ltr %w0" : : "q" (SEL_TSS));
+  asm volatile ("ltr %w0" : : "q" (sel_tss));
 }
 
 /* System segment or code/data segment? */
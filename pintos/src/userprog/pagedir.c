@@ -5,6 +5,8 @@
 #include "threads/init.h"
 #include "threads/pte.h"
 #include "threads/palloc.h"
+#include "threads/smp.h"
+#include "threads/thread.h"
 
 static uint32_t *active_pd (void);
 static void invalidate_pagedir (uint32_t *);
@@ -46,6 +48,7 @@ pagedir_destroy (uint32_t *pd)
           if (*pte & PTE_P)
             palloc_free_page (pte_get_page (*pte));
         palloc_free_page (pt);
+        cond_resched ();
       }
   palloc_free_page (pd);
 }
@@ -243,6 +246,7 @@ pagedir_activate (uint32_t *pd)
      new page tables immediately.  See [IA32-v2a] "MOV--Move
      to/from Control Registers" and [IA32-v3a] 3.7.5 "Base
      Address of the Page Directory". */
+  cpu_current ()->active_pd = pd;
   asm volatile ("movl %0, %%cr3" : : "r" (vtop (pd)) : "memory");
 }
 
@@ -273,7 +277,8 @@ active_pd (void)
  *
  * This function invalidates the TLB if PD is the active page
  * directory.  (If PD is not active then its entries are not in
- * the TLB, so there is no need to invalidate anything.)
+ * the TLB, so there is no need to invalidate anything.)  Other
+ * CPUs that have PD active are asked to do the same.
  **/
 static void
 invalidate_pagedir (uint32_t *pd)
@@ -284,4 +289,5 @@ invalidate_pagedir (uint32_t *pd)
          "Translation Lookaside Buffers (TLBs)". */
       pagedir_activate (pd);
     }
+  smp_tlb_shootdown (pd);
 }
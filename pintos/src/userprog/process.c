@@ -18,6 +18,9 @@
 #include "threads/synch.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
+#ifdef VM
+#include "vm/page.h"
+#endif
 
 
 #define align4(x)  (((((x)-1)>>2) <<2 ) + 4)
@@ -110,6 +113,14 @@ process_exit (void)
   struct thread *cur = thread_current ();
   uint32_t *pd;
 
+#ifdef VM
+  /* Give back the process's frames and swap slots, while its
+     page directory still maps them. */
+  page_table_destroy (&cur->pages);
+  file_close (cur->exec_file);
+  cur->exec_file = NULL;
+#endif
+
   /* Destroy the current process's page directory and switch back
      to the kernel-only page directory. */
   pd = cur->pagedir;
@@ -233,6 +244,10 @@ load (const char *file_name, void (**eip) (void), void **esp)
   t->pagedir = pagedir_create ();
   if (t->pagedir == NULL)
     goto done;
+#ifdef VM
+  if (!page_table_init (&t->pages))
+    goto done;
+#endif
   process_activate ();
   int stack_len = strlen (file_name);
 
@@ -372,13 +387,27 @@ load (const char *file_name, void (**eip) (void), void **esp)
   success = true;
   done:
   /* We arrive here whether the load is successful or not. */
+#ifdef VM
+  /* The executable's pages are read when they are first touched,
+     so keep it open, and unchanged, until the process exits. */
+  if (success)
+    {
+      file_deny_write (file);
+      t->exec_file = file;
+    }
+  else
+    file_close (file);
+#else
   file_close (file);
+#endif
   return success;
 }
 
 /* load() helpers. */
 
+#ifndef VM
 static bool install_page (void *upage, void *kpage, bool writable);
+#endif
 
 /* Checks whether PHDR describes a valid, loadable segment in
    FILE and returns true if so, false otherwise. */
@@ -455,6 +484,13 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
     size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
     size_t page_zero_bytes = PGSIZE - page_read_bytes;
 
+#ifdef VM
+    /* Record where the page comes from, to read it in when the
+       process first touches it. */
+    if (!page_add (upage, file, ofs, page_read_bytes, writable))
+      return false;
+    ofs += page_read_bytes;
+#else
     /* Get a page of memory. */
     uint8_t *kpage = palloc_get_page (PAL_USER);
     if (kpage == NULL)
@@ -472,6 +508,7 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
       palloc_free_page (kpage);
       return false;
     }
+#endif
 
     /* Advance. */
     read_bytes -= page_read_bytes;
@@ -486,6 +523,15 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
 static bool
 setup_stack (void **esp)
 {
+#ifdef VM
+  /* Bring the page in now, since load() writes the arguments to
+     it, but let it be evicted like any other page. */
+  uint8_t *upage = ((uint8_t *) PHYS_BASE) - PGSIZE;
+  if (!page_add (upage, NULL, 0, 0, true) || !page_fault_in (upage, true))
+    return false;
+  *esp = PHYS_BASE;
+  return true;
+#else
   uint8_t *kpage;
   bool success = false;
 
@@ -498,8 +544,10 @@ setup_stack (void **esp)
       palloc_free_page (kpage);
   }
   return success;
+#endif
 }
 
+#ifndef VM
 /* Adds a mapping from user virtual address UPAGE to kernel
    virtual address KPAGE to the page table.
    If WRITABLE is true, the user process may modify the page;
@@ -519,3 +567,4 @@ install_page (void *upage, void *kpage, bool writable)
   return (pagedir_get_page (t->pagedir, upage) == NULL
           && pagedir_set_page (t->pagedir, upage, kpage, writable));
 }
+#endif
@@ -6,11 +6,17 @@
 #include <string.h>
 #include <filesys/directory.h>
 #include <filesys/filesys.h>
-#include <threads/malloc.h>
+#include <threads/slab.h>
 #include <filesys/file.h>
+#include <time.h>
+#include "devices/timer.h"
 #include "threads/interrupt.h"
 #include "threads/thread.h"
 #include "pagedir.h"
+#include "userprog/futex.h"
+#ifdef VM
+#include "vm/page.h"
+#endif
 
 static void syscall_handler (struct intr_frame *);
 
@@ -28,6 +34,24 @@ static int sysfilesize (int fd);
 
 static int sysread (int fd, void *buffer, unsigned size);
 
+static int sysnice (int increment);
+
+static int sysschedstat (tid_t tid, struct schedstat *st);
+
+static int sysclock_gettime (int clock, struct timespec *ts);
+
+static int syssched_rt (int runtime, int period, int deadline);
+
+static int syssched_yield (void);
+
+static int syssched_group (int group, int weight, int cap);
+
+static int syssched_setgroup (int group);
+
+static int sysfutex_wait (int *futex, int expected);
+
+static int sysfutex_wake (int *futex, int n);
+
 typedef int (*handler) (uint32_t, uint32_t, uint32_t);
 
 static handler syscall_vec[128];
@@ -36,7 +60,12 @@ static struct fd_elem *get_file_from_current_thread_by_fd (int fd);
 
 static int alloc_fid (void);
 
+static void check_buffer (const void *uaddr, size_t size, bool write);
+
+static void release_buffer (const void *uaddr, size_t size);
+
 static struct list file_list;
+static struct kmem_cache *fd_cache;     /* Cache of fd_elems. */
 
 struct fd_elem
 {
@@ -57,8 +86,21 @@ syscall_init (void)
   syscall_vec[SYS_CLOSE]    = (handler) sysclose;
   syscall_vec[SYS_READ]     = (handler) sysread;
   syscall_vec[SYS_FILESIZE] = (handler) sysfilesize;
+  syscall_vec[SYS_NICE]     = (handler) sysnice;
+  syscall_vec[SYS_SCHEDSTAT] = (handler) sysschedstat;
+  syscall_vec[SYS_CLOCK_GETTIME] = (handler) sysclock_gettime;
+  syscall_vec[SYS_SCHED_RT] = (handler) syssched_rt;
+  syscall_vec[SYS_SCHED_YIELD] = (handler) syssched_yield;
+  syscall_vec[SYS_FUTEX_WAIT] = (handler) sysfutex_wait;
+  syscall_vec[SYS_FUTEX_WAKE] = (handler) sysfutex_wake;
+  syscall_vec[SYS_SCHED_GROUP] = (handler) syssched_group;
+  syscall_vec[SYS_SCHED_SETGROUP] = (handler) syssched_setgroup;
+
+  futex_init ();
 
   list_init (&file_list);
+  fd_cache = kmem_cache_create ("fd_elem", sizeof (struct fd_elem),
+                                NULL, NULL);
 }
 
 void validate_addr (uint32_t *addr, uint32_t cs)
@@ -75,7 +117,7 @@ syscall_handler (struct intr_frame *f UNUSED)
 
   validate_addr (args[0], 0);
 
-  if (args[0] < SYS_EXIT || args[0] > SYS_INUMBER) {
+  if (args[0] < SYS_EXIT || args[0] > SYS_SCHED_SETGROUP) {
     sysexit (-1);
   }
 
@@ -119,7 +161,7 @@ static int sysopen (const char *filename)
   struct file *f = filesys_open (filename); // 打开一个文件
   if (!f) return -1;
 
-  struct fd_elem *fdElem = (struct fd_elem *) malloc (sizeof (struct fd_elem));
+  struct fd_elem *fdElem = kmem_cache_alloc (fd_cache);
   if (!fdElem) {
     file_close (f);
     return -1;
@@ -141,18 +183,24 @@ static int sysopen (const char *filename)
 
 static int syswrite (int fd, const void *buffer, unsigned size)
 {
-  char *phy_buffer = pagedir_get_page (thread_current ()->pagedir, buffer);
-  if(fd == 1)
-    putbuf (phy_buffer, size);
-  else if(fd == 0)
+  struct fd_elem *elem = NULL;
+  int written = size;
+
+  if(fd == 0)
     sysexit (-1);
-  else{
-    struct fd_elem *elem =  get_file_from_current_thread_by_fd (fd);
+  else if(fd != 1){
+    elem = get_file_from_current_thread_by_fd (fd);
     if(!elem)
       sysexit (-1);
-    return file_write (elem->file_elem, buffer, size);
   }
 
+  check_buffer (buffer, size, false);
+  if(fd == 1)
+    putbuf (buffer, size);
+  else
+    written = file_write (elem->file_elem, buffer, size);
+  release_buffer (buffer, size);
+  return written;
 }
 
 
@@ -172,7 +220,7 @@ sysclose (int fd)
   file_close (elem->file_elem);
   list_remove (&elem->thread_elem);
   list_remove (&elem->elem);
-  free (elem);
+  kmem_cache_free (fd_cache, elem);
   return 0;
 }
 
@@ -197,9 +245,14 @@ get_file_from_current_thread_by_fd (int fd)
 static int sysread (int fd, void *buffer, unsigned size)
 {
   struct fd_elem *elem = get_file_from_current_thread_by_fd (fd);
+  int bytes_read;
+
   if (!elem)
     sysexit (-1);
-  return file_read (elem->file_elem, buffer, size);
+  check_buffer (buffer, size, true);
+  bytes_read = file_read (elem->file_elem, buffer, size);
+  release_buffer (buffer, size);
+  return bytes_read;
 }
 
 static int sysfilesize (int fd)
@@ -211,3 +264,190 @@ static int sysfilesize (int fd)
 
   return file_length(elem->file_elem);
 }
+
+/* Adds INCREMENT to the calling process's nice value, clamped
+   to NICE_MIN...NICE_MAX, and returns the new value.  Only the
+   MLFQS scheduler takes niceness into account. */
+static int
+sysnice (int increment)
+{
+  /* Clamp first, so that the sum cannot overflow. */
+  if (increment < NICE_MIN - NICE_MAX)
+    increment = NICE_MIN - NICE_MAX;
+  else if (increment > NICE_MAX - NICE_MIN)
+    increment = NICE_MAX - NICE_MIN;
+  thread_set_nice (thread_get_nice () + increment);
+  return thread_get_nice ();
+}
+
+/* Copies the scheduling statistics of thread TID, or of the
+   calling thread if TID is 0, to user buffer ST.  Returns true
+   if successful, false if there is no such thread. */
+static int
+sysschedstat (tid_t tid, struct schedstat *st)
+{
+  struct schedstat buf;
+  bool found;
+
+  check_buffer (st, sizeof *st, true);
+  if (tid == 0)
+    tid = thread_tid ();
+  found = thread_get_schedstat (tid, &buf);
+  if (found)
+    memcpy (st, &buf, sizeof buf);
+  release_buffer (st, sizeof *st);
+  return found;
+}
+
+static int
+sysclock_gettime (int clock, struct timespec *ts)
+{
+  int64_t ns;
+
+  check_buffer (ts, sizeof *ts, true);
+  if (clock == CLOCK_MONOTONIC)
+    ns = timer_nanoseconds ();
+  else if (clock == CLOCK_REALTIME)
+    ns = timer_realtime ();
+  else
+    {
+      release_buffer (ts, sizeof *ts);
+      return false;
+    }
+  ts->tv_sec = ns / 1000000000;
+  ts->tv_nsec = ns % 1000000000;
+  release_buffer (ts, sizeof *ts);
+  return true;
+}
+
+static int
+syssched_rt (int runtime, int period, int deadline)
+{
+  return thread_set_rt (runtime, period, deadline);
+}
+
+static int
+syssched_yield (void)
+{
+  thread_rt_yield ();
+  return 0;
+}
+
+/* Sets the weight and cap of CPU group GROUP, which must be the
+   calling process's own, and may only become more restrictive.
+   Otherwise groups are configured on the kernel command line
+   (option "-group"). */
+static int
+syssched_group (int group, int weight, int cap)
+{
+  return thread_group_tighten (group, weight, cap);
+}
+
+/* Moves the calling process to CPU group GROUP, which must be
+   unused and restrict it at least as much as its current
+   group. */
+static int
+syssched_setgroup (int group)
+{
+  return thread_restrict_group (group);
+}
+
+/* Exits the process unless the SIZE bytes at UADDR all lie in
+   its address space and, if WRITE is true, are writable.  With
+   virtual memory, also brings the buffer's pages in and pins
+   them until release_buffer(), so that they cannot be evicted
+   while the kernel uses them, possibly with a file system lock
+   held that reading them back in would need. */
+static void
+check_buffer (const void *uaddr, size_t size, bool write UNUSED)
+{
+  const uint8_t *start = uaddr;
+  const uint8_t *end = start + size;
+  const uint8_t *upage;
+
+  if (size == 0)
+    return;
+  if (start == NULL || end < start || !is_user_vaddr (end - 1))
+    sysexit (-1);
+  for (upage = pg_round_down (start); upage < end; upage += PGSIZE)
+    {
+#ifdef VM
+      struct page *p = page_lookup (&thread_current ()->pages, upage);
+      if (p == NULL || (write && !p->writable) || !page_pin (upage))
+        {
+          /* Unpin the pages pinned so far, since exiting frees
+             every frame. */
+          if (upage > start)
+            release_buffer (start, upage - start);
+          sysexit (-1);
+        }
+#else
+      if (pagedir_get_page (thread_current ()->pagedir, upage) == NULL)
+        sysexit (-1);
+#endif
+    }
+}
+
+/* Releases the SIZE bytes at UADDR after check_buffer(). */
+static void
+release_buffer (const void *uaddr UNUSED, size_t size UNUSED)
+{
+#ifdef VM
+  const uint8_t *start = uaddr;
+  const uint8_t *end = start + size;
+  const uint8_t *upage;
+
+  for (upage = pg_round_down (start); upage < end; upage += PGSIZE)
+    page_unpin (upage);
+#endif
+}
+
+/* Exits the process unless FUTEX is an aligned, mapped user
+   address.  With virtual memory, brings FUTEX's page in and pins
+   it until release_futex(). */
+static void
+check_futex (int *futex)
+{
+  if ((uintptr_t) futex % sizeof *futex != 0 || !is_user_vaddr (futex))
+    sysexit (-1);
+#ifdef VM
+  /* A futex is known by its kernel address, so its page must
+     stay in the same frame while it is in use. */
+  if (!page_pin (futex))
+    sysexit (-1);
+#else
+  if (pagedir_get_page (thread_current ()->pagedir, futex) == NULL)
+    sysexit (-1);
+#endif
+}
+
+/* Releases FUTEX after check_futex(). */
+static void
+release_futex (int *futex UNUSED)
+{
+#ifdef VM
+  page_unpin (futex);
+#endif
+}
+
+static int
+sysfutex_wait (int *futex, int expected)
+{
+  bool woken;
+
+  check_futex (futex);
+  woken = futex_wait (thread_current ()->pagedir, futex, expected);
+  release_futex (futex);
+  return woken ? 0 : -1;
+}
+
+static int
+sysfutex_wake (int *futex, int n)
+{
+  int woken;
+
+  check_futex (futex);
+  woken = n > 0 ? futex_wake (thread_current ()->pagedir, futex, n) : 0;
+  release_futex (futex);
+  return woken;
+}
@@ -4,6 +4,7 @@
 #include "userprog/gdt.h"
 #include "threads/thread.h"
 #include "threads/palloc.h"
+#include "threads/smp.h"
 #include "threads/vaddr.h"
 
 /* The Task-State Segment (TSS).
@@ -72,35 +73,40 @@ struct tss
     uint16_t trace, bitmap;
   };
 
-/* Kernel TSS. */
-static struct tss *tss;
+/* Kernel TSS of each CPU, indexed by CPU id.  Each CPU takes
+   interrupts from user mode on the stack of the thread it is
+   running, so each needs its own TSS. */
+static struct tss *tss[CPU_MAX];
 
-/* Initializes the kernel TSS. */
+/* Initializes the kernel TSS of the running CPU. */
 void
 tss_init (void)
 {
+  struct tss *t;
+
   /* Our TSS is never used in a call gate or task gate, so only a
      few fields of it are ever referenced, and those are the only
      ones we initialize. */
-  tss = palloc_get_page (PAL_ASSERT | PAL_ZERO);
-  tss->ss0 = SEL_KDSEG;
-  tss->bitmap = 0xdfff;
+  t = palloc_get_page (PAL_ASSERT | PAL_ZERO);
+  t->ss0 = SEL_KDSEG;
+  t->bitmap = 0xdfff;
+  tss[cpu_current ()->id] = t;
   tss_update ();
 }
 
-/* Returns the kernel TSS. */
+/* Returns the kernel TSS of the running CPU. */
 struct tss *
 tss_get (void)
 {
-  ASSERT (tss != NULL);
-  return tss;
+  struct tss *t = tss[cpu_current ()->id];
+  ASSERT (t != NULL);
+  return t;
 }
 
-/* Sets the ring 0 stack pointer in the TSS to point to the end
-   of the thread stack. */
+/* Sets the ring 0 stack pointer in the running CPU's TSS to
+   point to the end of the thread stack. */
 void
 tss_update (void)
 {
-  ASSERT (tss != NULL);
-  tss->esp0 = (uint8_t *) thread_current () + PGSIZE;
+  tss_get ()->esp0 = (uint8_t *) thread_current () + PGSIZE;
 }
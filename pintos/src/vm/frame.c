@@ -0,0 +1,226 @@
+#include "vm/frame.h"
+#include <debug.h>
+#include <stdio.h>
+#include "threads/palloc.h"
+#include "threads/slab.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "userprog/pagedir.h"
+#include "vm/page.h"
+
+/* Frame table.
+
+   Every frame in the user pool that holds a user page is in
+   frame_list, which records the process that owns it and the
+   page it holds.  When the user pool runs out, frame_alloc()
+   evicts a page with the "second chance" clock algorithm: the
+   clock hand sweeps frame_list, clearing the accessed bit of
+   each page that has it set and taking the first page that does
+   not.  page_out() then writes the page to swap, unless it is
+   clean and can be read back in from its file or recreated as
+   zeros.
+
+   A pinned frame is never evicted.  frame_alloc() returns a
+   pinned frame, so that its page can be read in before anyone
+   else can take it.
+
+   frame_lock protects the frame table, the `frame' member of
+   every page, and the other members of every page in memory,
+   which an evicting thread changes.  It is held throughout an
+   eviction, including writing the page to swap, so a process
+   that faults on a page being evicted waits for the eviction to
+   finish. */
+
+static struct lock frame_lock;
+static struct list frame_list;          /* All frames. */
+static struct list_elem *hand;          /* Clock hand in frame_list. */
+static struct kmem_cache *frame_cache;  /* Cache of struct frame. */
+
+/* Statistics. */
+static size_t frame_cnt;                /* Frames in frame_list. */
+static unsigned long long evict_cnt;    /* Pages evicted. */
+
+static void *evict (void);
+static void remove_frame (struct frame *);
+
+/* Initializes the frame table. */
+void
+frame_init (void)
+{
+  lock_init_named (&frame_lock, "frame");
+  list_init (&frame_list);
+  hand = list_end (&frame_list);
+  frame_cache = kmem_cache_create ("frame", sizeof (struct frame),
+                                   NULL, NULL);
+}
+
+/* Obtains a frame to hold page P of the running process,
+   evicting another page if the user pool is exhausted, makes it
+   P's frame, and returns it, pinned.  Returns a null pointer if
+   no frame is available and none can be evicted. */
+struct frame *
+frame_alloc (struct page *p)
+{
+  struct frame *f;
+  void *kpage;
+
+  lock_acquire (&frame_lock);
+  f = kmem_cache_alloc (frame_cache);
+  if (f == NULL)
+    {
+      lock_release (&frame_lock);
+      return NULL;
+    }
+
+  kpage = palloc_get_page (PAL_USER);
+  if (kpage == NULL)
+    kpage = evict ();
+  if (kpage == NULL)
+    {
+      kmem_cache_free (frame_cache, f);
+      lock_release (&frame_lock);
+      return NULL;
+    }
+
+  f->kpage = kpage;
+  f->owner = thread_current ();
+  f->page = p;
+  f->pin_cnt = 1;
+  p->frame = f;
+  list_push_back (&frame_list, &f->elem);
+  frame_cnt++;
+  lock_release (&frame_lock);
+
+  return f;
+}
+
+/* Frees frame F, whose page has not been mapped or has been
+   unmapped. */
+void
+frame_free (struct frame *f)
+{
+  lock_acquire (&frame_lock);
+  remove_frame (f);
+  lock_release (&frame_lock);
+}
+
+/* Unmaps and frees every frame that belongs to process T. */
+void
+frame_free_owner (struct thread *t)
+{
+  struct list_elem *e, *next;
+
+  lock_acquire (&frame_lock);
+  for (e = list_begin (&frame_list); e != list_end (&frame_list); e = next)
+    {
+      struct frame *f = list_entry (e, struct frame, elem);
+
+      next = list_next (e);
+      if (f->owner == t)
+        {
+          ASSERT (f->pin_cnt == 0);
+          pagedir_clear_page (t->pagedir, f->page->upage);
+          remove_frame (f);
+        }
+    }
+  lock_release (&frame_lock);
+}
+
+/* Pins the frame that holds page P, if P is in memory, and
+   returns true.  Returns false if P is not in memory. */
+bool
+frame_pin (struct page *p)
+{
+  bool pinned = false;
+
+  lock_acquire (&frame_lock);
+  if (p->frame != NULL)
+    {
+      p->frame->pin_cnt++;
+      pinned = true;
+    }
+  lock_release (&frame_lock);
+
+  return pinned;
+}
+
+/* Unpins frame F, which must be pinned. */
+void
+frame_unpin (struct frame *f)
+{
+  lock_acquire (&frame_lock);
+  ASSERT (f->pin_cnt > 0);
+  f->pin_cnt--;
+  lock_release (&frame_lock);
+}
+
+/* Prints frame table statistics. */
+void
+frame_print_stats (void)
+{
+  lock_acquire (&frame_lock);
+  printf ("Frames: %zu in use, %llu evictions\n", frame_cnt, evict_cnt);
+  lock_release (&frame_lock);
+}
+
+/* Evicts a page with the clock algorithm and returns its frame's
+   kernel virtual address, or a null pointer if no page can be
+   evicted.  frame_lock must be held. */
+static void *
+evict (void)
+{
+  size_t steps;
+
+  /* Two sweeps clear every accessed bit and then visit every
+     frame once more. */
+  for (steps = 0; steps < 2 * frame_cnt + 1; steps++)
+    {
+      struct frame *f;
+      uint32_t *pd;
+      void *upage, *kpage;
+
+      if (hand == list_end (&frame_list))
+        {
+          hand = list_begin (&frame_list);
+          if (hand == list_end (&frame_list))
+            return NULL;
+        }
+      f = list_entry (hand, struct frame, elem);
+      hand = list_next (hand);
+
+      if (f->pin_cnt > 0)
+        continue;
+      pd = f->owner->pagedir;
+      upage = f->page->upage;
+      if (pagedir_is_accessed (pd, upage))
+        {
+          pagedir_set_accessed (pd, upage, false);
+          continue;
+        }
+      if (!page_out (f->page, pd, f->kpage))
+        continue;
+
+      kpage = f->kpage;
+      list_remove (&f->elem);
+      frame_cnt--;
+      evict_cnt++;
+      kmem_cache_free (frame_cache, f);
+      return kpage;
+    }
+  return NULL;
+}
+
+/* Removes frame F from the frame table and frees it and its
+   page.  frame_lock must be held. */
+static void
+remove_frame (struct frame *f)
+{
+  if (hand == &f->elem)
+    hand = list_next (hand);
+  list_remove (&f->elem);
+  frame_cnt--;
+  if (f->page->frame == f)
+    f->page->frame = NULL;
+  palloc_free_page (f->kpage);
+  kmem_cache_free (frame_cache, f);
+}
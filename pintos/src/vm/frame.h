@@ -0,0 +1,28 @@
+#ifndef VM_FRAME_H
+#define VM_FRAME_H
+
+#include <list.h>
+#include <stdbool.h>
+
+struct page;
+
+/* A frame of physical memory in the user pool that holds a page
+   of a user process. */
+struct frame
+  {
+    void *kpage;                /* Kernel virtual address. */
+    struct thread *owner;       /* Process whose page this is. */
+    struct page *page;          /* Page held, in OWNER's page table. */
+    int pin_cnt;                /* Evictable only if zero. */
+    struct list_elem elem;      /* Element in frame table. */
+  };
+
+void frame_init (void);
+struct frame *frame_alloc (struct page *);
+void frame_free (struct frame *);
+void frame_free_owner (struct thread *);
+bool frame_pin (struct page *);
+void frame_unpin (struct frame *);
+void frame_print_stats (void);
+
+#endif /* vm/frame.h */
@@ -0,0 +1,279 @@
+#include "vm/page.h"
+#include <debug.h>
+#include <string.h>
+#include "filesys/file.h"
+#include "threads/palloc.h"
+#include "threads/slab.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+#include "vm/frame.h"
+#include "vm/swap.h"
+
+/* Supplemental page table.
+
+   Each process has a hash table of the pages in its address
+   space, keyed on user virtual address, that says where each
+   page's contents come from.  load() fills it in with the pages
+   of the executable's segments instead of reading them, and the
+   page fault handler reads each page in, and maps it, the first
+   time the process touches it.  A page that is never touched is
+   never read.
+
+   When memory runs short, the frame table evicts pages (see
+   frame.c).  A page that was written to, or that came from swap
+   before, goes to swap and becomes a PAGE_SWAP page; a clean
+   file or zero page is simply dropped, since it can be read or
+   zeroed again.
+
+   Only the process's own thread adds pages to or removes pages
+   from its page table, so the table itself needs no lock.  The
+   members of a page in memory are protected by the frame table's
+   lock, since an evicting thread may change them. */
+
+/* Cache of struct page. */
+static struct kmem_cache *page_cache;
+
+static hash_hash_func page_hash;
+static hash_less_func page_less;
+static hash_action_func page_destroy;
+static bool page_in (struct page *, bool pin);
+static bool page_load (struct page *, void *kpage);
+
+/* Initializes the supplemental page table module. */
+void
+page_init (void)
+{
+  page_cache = kmem_cache_create ("page", sizeof (struct page), NULL, NULL);
+}
+
+/* Initializes PAGES as an empty supplemental page table.
+   Returns true if successful, false if memory allocation
+   failed. */
+bool
+page_table_init (struct hash *pages)
+{
+  return hash_init (pages, page_hash, page_less, NULL);
+}
+
+/* Destroys PAGES, the running process's page table, which may
+   also be all zeros if it was never initialized.  Unmaps and
+   frees the frames of its pages that are in memory, and the swap
+   slots of those that are not. */
+void
+page_table_destroy (struct hash *pages)
+{
+  struct thread *t = thread_current ();
+
+  if (t->pagedir != NULL)
+    frame_free_owner (t);
+  hash_destroy (pages, page_destroy);
+}
+
+/* Adds UPAGE to the running process's page table, with contents
+   READ_BYTES bytes read from FILE at offset OFS followed by
+   zeros, or all zeros if READ_BYTES is 0.  FILE must remain open
+   for as long as the process runs.  The user process may write
+   to the page if WRITABLE is true.  Returns true if successful,
+   false if UPAGE is already in the table or memory allocation
+   failed. */
+bool
+page_add (void *upage, struct file *file, off_t ofs, size_t read_bytes,
+          bool writable)
+{
+  struct thread *t = thread_current ();
+  struct page *p;
+
+  ASSERT (pg_ofs (upage) == 0);
+  ASSERT (read_bytes <= PGSIZE);
+
+  p = kmem_cache_alloc (page_cache);
+  if (p == NULL)
+    return false;
+  p->upage = upage;
+  p->type = read_bytes > 0 ? PAGE_FILE : PAGE_ZERO;
+  p->writable = writable;
+  p->frame = NULL;
+  p->file = file;
+  p->ofs = ofs;
+  p->read_bytes = read_bytes;
+  p->swap_slot = SWAP_ERROR;
+
+  if (hash_insert (&t->pages, &p->elem) != NULL)
+    {
+      kmem_cache_free (page_cache, p);
+      return false;
+    }
+  return true;
+}
+
+/* Returns the page in PAGES that contains ADDR, or a null
+   pointer if there is none. */
+struct page *
+page_lookup (struct hash *pages, const void *addr)
+{
+  struct page p;
+  struct hash_elem *e;
+
+  p.upage = pg_round_down (addr);
+  e = hash_find (pages, &p.elem);
+  return e != NULL ? hash_entry (e, struct page, elem) : NULL;
+}
+
+/* Brings the page that contains ADDR, which the running process
+   faulted on, into memory and maps it.  WRITE is true if the
+   faulting access was a write.  Returns true if successful,
+   false if ADDR is not in the process's page table, WRITE is
+   true for a read-only page, or the page could not be read. */
+bool
+page_fault_in (const void *addr, bool write)
+{
+  struct thread *t = thread_current ();
+  struct page *p;
+
+  if (t->pagedir == NULL)
+    return false;
+  p = page_lookup (&t->pages, addr);
+  if (p == NULL || (write && !p->writable))
+    return false;
+  return page_in (p, false);
+}
+
+/* Brings the page that contains user address ADDR into memory,
+   if it is not there already, and keeps it there until
+   page_unpin() is called for ADDR.  Returns true if successful,
+   false if ADDR is not in the running process's page table or
+   the page could not be read. */
+bool
+page_pin (const void *addr)
+{
+  struct page *p = page_lookup (&thread_current ()->pages, addr);
+
+  if (p == NULL)
+    return false;
+  return frame_pin (p) || page_in (p, true);
+}
+
+/* Undoes one page_pin() call for user address ADDR. */
+void
+page_unpin (const void *addr)
+{
+  struct page *p = page_lookup (&thread_current ()->pages, addr);
+
+  ASSERT (p != NULL && p->frame != NULL);
+  frame_unpin (p->frame);
+}
+
+/* Evicts page P, which is mapped in page directory PD to the
+   frame at KPAGE: unmaps it and, unless it can be brought back
+   from its file or as zeros, writes it to swap.  Returns true
+   if successful, false if there was no swap slot for it, in
+   which case P stays in memory.  The frame table's lock must be
+   held. */
+bool
+page_out (struct page *p, uint32_t *pd, void *kpage)
+{
+  pagedir_clear_page (pd, p->upage);
+  if (p->type == PAGE_SWAP || pagedir_is_dirty (pd, p->upage))
+    {
+      size_t slot = swap_out (kpage);
+      if (slot == SWAP_ERROR)
+        {
+          pagedir_set_page (pd, p->upage, kpage, p->writable);
+          pagedir_set_dirty (pd, p->upage, true);
+          return false;
+        }
+      p->type = PAGE_SWAP;
+      p->swap_slot = slot;
+    }
+  p->frame = NULL;
+  return true;
+}
+
+/* Reads page P of the running process into a new frame and maps
+   it.  If PIN is true, leaves the frame pinned.  Returns true if
+   successful, false on failure. */
+static bool
+page_in (struct page *p, bool pin)
+{
+  struct thread *t = thread_current ();
+  struct frame *f;
+
+  f = frame_alloc (p);
+  if (f == NULL)
+    return false;
+  if (!page_load (p, f->kpage)
+      || !pagedir_set_page (t->pagedir, p->upage, f->kpage, p->writable))
+    {
+      frame_free (f);
+      return false;
+    }
+
+  /* Only now that the page is mapped is its swap slot no longer
+     needed.  Until then, a failure leaves it there to retry. */
+  if (p->swap_slot != SWAP_ERROR)
+    {
+      swap_free (p->swap_slot);
+      p->swap_slot = SWAP_ERROR;
+    }
+  if (!pin)
+    frame_unpin (f);
+  return true;
+}
+
+/* Fills KPAGE with the contents of page P.  Returns true if
+   successful, false if reading failed. */
+static bool
+page_load (struct page *p, void *kpage)
+{
+  switch (p->type)
+    {
+    case PAGE_FILE:
+      if (file_read_at (p->file, kpage, p->read_bytes, p->ofs)
+          != (off_t) p->read_bytes)
+        return false;
+      memset ((uint8_t *) kpage + p->read_bytes, 0, PGSIZE - p->read_bytes);
+      return true;
+
+    case PAGE_ZERO:
+      memset (kpage, 0, PGSIZE);
+      return true;
+
+    case PAGE_SWAP:
+      swap_in (p->swap_slot, kpage);
+      return true;
+    }
+  NOT_REACHED ();
+}
+
+/* Returns a hash value for the page that E refers to. */
+static unsigned
+page_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct page *p = hash_entry (e, struct page, elem);
+  return hash_bytes (&p->upage, sizeof p->upage);
+}
+
+/* Returns true if the page that A refers to precedes the one
+   that B refers to. */
+static bool
+page_less (const struct hash_elem *a_, const struct hash_elem *b_,
+           void *aux UNUSED)
+{
+  const struct page *a = hash_entry (a_, struct page, elem);
+  const struct page *b = hash_entry (b_, struct page, elem);
+  return a->upage < b->upage;
+}
+
+/* Frees the page that E refers to, and its swap slot, if it has
+   one. */
+static void
+page_destroy (struct hash_elem *e, void *aux UNUSED)
+{
+  struct page *p = hash_entry (e, struct page, elem);
+
+  ASSERT (p->frame == NULL);
+  if (p->swap_slot != SWAP_ERROR)
+    swap_free (p->swap_slot);
+  kmem_cache_free (page_cache, p);
+}
@@ -0,0 +1,52 @@
+#ifndef VM_PAGE_H
+#define VM_PAGE_H
+
+#include <hash.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "filesys/off_t.h"
+
+struct file;
+struct frame;
+
+/* Where the contents of a page come from when it is brought into
+   memory. */
+enum page_type
+  {
+    PAGE_FILE,                  /* Read from a file, then zeros. */
+    PAGE_ZERO,                  /* All zeros. */
+    PAGE_SWAP                   /* Swap slot, once written out. */
+  };
+
+/* A page of a process's virtual address space, in its
+   supplemental page table. */
+struct page
+  {
+    struct hash_elem elem;      /* Element in owner's page table. */
+    void *upage;                /* User virtual address. */
+    enum page_type type;        /* Backing. */
+    bool writable;              /* Writable by the user process? */
+    struct frame *frame;        /* Frame in memory, or null. */
+
+    /* For PAGE_FILE. */
+    struct file *file;          /* File to read. */
+    off_t ofs;                  /* Offset in FILE. */
+    size_t read_bytes;          /* Bytes to read; the rest are zeroed. */
+
+    /* For PAGE_SWAP. */
+    size_t swap_slot;           /* Slot, or SWAP_ERROR while in memory. */
+  };
+
+void page_init (void);
+bool page_table_init (struct hash *);
+void page_table_destroy (struct hash *);
+bool page_add (void *upage, struct file *, off_t ofs, size_t read_bytes,
+               bool writable);
+struct page *page_lookup (struct hash *, const void *addr);
+bool page_fault_in (const void *addr, bool write);
+bool page_pin (const void *addr);
+void page_unpin (const void *addr);
+bool page_out (struct page *, uint32_t *pd, void *kpage);
+
+#endif /* vm/page.h */
@@ -0,0 +1,104 @@
+#include "vm/swap.h"
+#include <bitmap.h>
+#include <debug.h>
+#include <stdio.h>
+#include "devices/block.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* Swap.
+
+   The swap device is divided into page-size "slots", and a
+   bitmap records which of them are in use.  Without a swap
+   device, there are no slots, and only pages that can be read
+   back in from elsewhere can be evicted. */
+
+/* Number of sectors in a swap slot. */
+#define SECTORS_PER_SLOT (PGSIZE / BLOCK_SECTOR_SIZE)
+
+static struct block *swap_device;
+static struct bitmap *used_map;         /* Slots in use. */
+static struct lock swap_lock;           /* Protects used_map. */
+
+/* Statistics. */
+static unsigned long long write_cnt, read_cnt;
+
+/* Initializes swap, using the BLOCK_SWAP device if there is
+   one. */
+void
+swap_init (void)
+{
+  lock_init_named (&swap_lock, "swap");
+  swap_device = block_get_role (BLOCK_SWAP);
+  if (swap_device == NULL)
+    return;
+
+  used_map = bitmap_create (block_size (swap_device) / SECTORS_PER_SLOT);
+  if (used_map == NULL)
+    PANIC ("bitmap creation failed--swap device is too large");
+}
+
+/* Writes the page at KPAGE to a free swap slot and returns the
+   slot, or SWAP_ERROR if there is none. */
+size_t
+swap_out (const void *kpage)
+{
+  size_t slot;
+  size_t i;
+
+  if (used_map == NULL)
+    return SWAP_ERROR;
+
+  lock_acquire (&swap_lock);
+  slot = bitmap_scan_and_flip (used_map, 0, 1, false);
+  if (slot != BITMAP_ERROR)
+    write_cnt++;
+  lock_release (&swap_lock);
+  if (slot == BITMAP_ERROR)
+    return SWAP_ERROR;
+
+  for (i = 0; i < SECTORS_PER_SLOT; i++)
+    block_write (swap_device, slot * SECTORS_PER_SLOT + i,
+                 (const uint8_t *) kpage + i * BLOCK_SECTOR_SIZE);
+  return slot;
+}
+
+/* Reads swap slot SLOT into the page at KPAGE.  The slot stays
+   in use until swap_free(). */
+void
+swap_in (size_t slot, void *kpage)
+{
+  size_t i;
+
+  for (i = 0; i < SECTORS_PER_SLOT; i++)
+    block_read (swap_device, slot * SECTORS_PER_SLOT + i,
+                (uint8_t *) kpage + i * BLOCK_SECTOR_SIZE);
+
+  lock_acquire (&swap_lock);
+  read_cnt++;
+  lock_release (&swap_lock);
+}
+
+/* Frees swap slot SLOT. */
+void
+swap_free (size_t slot)
+{
+  lock_acquire (&swap_lock);
+  ASSERT (bitmap_test (used_map, slot));
+  bitmap_reset (used_map, slot);
+  lock_release (&swap_lock);
+}
+
+/* Prints swap statistics. */
+void
+swap_print_stats (void)
+{
+  if (used_map == NULL)
+    return;
+
+  lock_acquire (&swap_lock);
+  printf ("Swap: %zu of %zu slots in use, %llu writes, %llu reads\n",
+          bitmap_count (used_map, 0, bitmap_size (used_map), true),
+          bitmap_size (used_map), write_cnt, read_cnt);
+  lock_release (&swap_lock);
+}